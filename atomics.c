@@ -400,11 +400,11 @@ cm_atomic64_fetch_or(cmAtomic64 volatile *a, i64 operand) {
 
 cm_inline b32 
 cm_atomic32_spin_lock(cmAtomic32 volatile *a, isize time_out) {
-	i32 old_value = cm_atomic32_compare_exchange(a, 1, 0);
+	i32 old_value = cm_atomic32_compare_exchange(a, 0, 1);
 	i32 counter = 0;
 	while (old_value != 0 && (time_out < 0 || counter++ < time_out)) {
 		cm_yield_thread();
-		old_value = cm_atomic32_compare_exchange(a, 1, 0);
+		old_value = cm_atomic32_compare_exchange(a, 0, 1);
 		cm_mfence();
 	}
 	return old_value == 0;
@@ -418,11 +418,11 @@ cm_atomic32_spin_unlock(cmAtomic32 volatile *a) {
 
 cm_inline b32 
 cm_atomic64_spin_lock(cmAtomic64 volatile *a, isize time_out) {
-	i64 old_value = cm_atomic64_compare_exchange(a, 1, 0);
+	i64 old_value = cm_atomic64_compare_exchange(a, 0, 1);
 	i64 counter = 0;
 	while (old_value != 0 && (time_out < 0 || counter++ < time_out)) {
 		cm_yield_thread();
-		old_value = cm_atomic64_compare_exchange(a, 1, 0);
+		old_value = cm_atomic64_compare_exchange(a, 0, 1);
 		cm_mfence();
 	}
 	return old_value == 0;
@@ -438,7 +438,7 @@ cm_inline b32
 cm_atomic32_try_acquire_lock(cmAtomic32 volatile *a) {
 	i32 old_value;
 	cm_yield_thread();
-	old_value = cm_atomic32_compare_exchange(a, 1, 0);
+	old_value = cm_atomic32_compare_exchange(a, 0, 1);
 	cm_mfence();
 	return old_value == 0;
 }
@@ -447,7 +447,7 @@ cm_inline b32
 cm_atomic64_try_acquire_lock(cmAtomic64 volatile *a) {
 	i64 old_value;
 	cm_yield_thread();
-	old_value = cm_atomic64_compare_exchange(a, 1, 0);
+	old_value = cm_atomic64_compare_exchange(a, 0, 1);
 	cm_mfence();
 	return old_value == 0;
 }
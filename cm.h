@@ -38,6 +38,8 @@
 #include "string.h"
 #include "hash.h"
 #include "hashtable.h"
+#include "slotmap.h"
+#include "disktable.h"
 #include "file.h"
 #include "print.h"
 #include "time.h"
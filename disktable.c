@@ -0,0 +1,318 @@
+/********************************************************************************
+ * MIT License
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Copyright (c) 2020 Sarayu Nhookeaw
+ *
+ ********************************************************************************/
+
+#include "disktable.h"
+#include "debug.h"
+#include "header.h"
+#include "endian.h"
+
+//
+// Mapped Files
+//
+
+#if defined(CM_SYS_WINDOWS)
+
+cm_internal b32
+cm__mapped_file_open(cmMappedFile *f, char const *filename, isize size) {
+	// NOTE: size < 0 maps an existing file read only, otherwise creates a file of `size` bytes to write
+	b32 writable = size >= 0;
+	LARGE_INTEGER file_size;
+	cm_zero_item(f);
+	f->win32_file = CreateFileA(filename, writable ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ,
+	                            NULL, writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f->win32_file == INVALID_HANDLE_VALUE)
+		return false;
+	if (!writable) {
+		if (!GetFileSizeEx(f->win32_file, &file_size) || file_size.QuadPart == 0) {
+			CloseHandle(f->win32_file);
+			return false;
+		}
+		size = cast(isize)file_size.QuadPart;
+	}
+	f->win32_mapping = CreateFileMappingA(f->win32_file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+	                                      cast(DWORD)(cast(u64)size >> 32), cast(DWORD)size, NULL);
+	if (f->win32_mapping == NULL) {
+		CloseHandle(f->win32_file);
+		return false;
+	}
+	f->data = cast(u8 *)MapViewOfFile(f->win32_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+	if (f->data == NULL) {
+		CloseHandle(f->win32_mapping);
+		CloseHandle(f->win32_file);
+		return false;
+	}
+	f->size = size;
+	return true;
+}
+
+cm_internal b32
+cm__mapped_file_close(cmMappedFile *f, isize truncate_size) {
+	// NOTE: truncate_size >= 0 flushes a written file and cuts it to that size
+	b32 ok = true;
+	if (truncate_size >= 0)
+		ok = FlushViewOfFile(f->data, 0) != 0;
+	UnmapViewOfFile(f->data);
+	CloseHandle(f->win32_mapping);
+	if (truncate_size >= 0) {
+		LARGE_INTEGER offset;
+		offset.QuadPart = truncate_size;
+		ok = ok && SetFilePointerEx(f->win32_file, offset, NULL, FILE_BEGIN) && SetEndOfFile(f->win32_file);
+		ok = ok && FlushFileBuffers(f->win32_file);
+	}
+	CloseHandle(f->win32_file);
+	cm_zero_item(f);
+	return ok;
+}
+
+#else
+
+cm_internal b32
+cm__mapped_file_open(cmMappedFile *f, char const *filename, isize size) {
+	// NOTE: size < 0 maps an existing file read only, otherwise creates a file of `size` bytes to write
+	b32 writable = size >= 0;
+	struct stat st;
+	void *data;
+	cm_zero_item(f);
+	f->posix_fd = open(filename, writable ? O_RDWR|O_CREAT|O_TRUNC : O_RDONLY, 0644);
+	if (f->posix_fd < 0)
+		return false;
+	if (writable) {
+		if (ftruncate(f->posix_fd, size) != 0) {
+			close(f->posix_fd);
+			return false;
+		}
+	} else {
+		if (fstat(f->posix_fd, &st) != 0 || st.st_size == 0) {
+			close(f->posix_fd);
+			return false;
+		}
+		size = cast(isize)st.st_size;
+	}
+	data = mmap(NULL, size, writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, f->posix_fd, 0);
+	if (data == MAP_FAILED) {
+		close(f->posix_fd);
+		return false;
+	}
+	// NOTE: Lookups land anywhere in the file, read ahead would only fetch pages nobody asked for
+	if (!writable)
+		posix_madvise(data, size, POSIX_MADV_RANDOM);
+	f->data = cast(u8 *)data;
+	f->size = size;
+	return true;
+}
+
+cm_internal b32
+cm__mapped_file_close(cmMappedFile *f, isize truncate_size) {
+	// NOTE: truncate_size >= 0 flushes a written file and cuts it to that size
+	b32 ok = true;
+	if (truncate_size >= 0)
+		ok = msync(f->data, f->size, MS_SYNC) == 0;
+	munmap(f->data, f->size);
+	if (truncate_size >= 0) {
+		ok = ok && ftruncate(f->posix_fd, truncate_size) == 0;
+		ok = ok && fsync(f->posix_fd) == 0;
+	}
+	close(f->posix_fd);
+	cm_zero_item(f);
+	return ok;
+}
+
+#endif
+
+
+//
+// On Disk Hash Table
+//
+
+cm_internal isize
+cm__disk_table_entry_size(isize value_size) {
+	return cm_size_of(u64) + ((value_size + 7) & ~7);
+}
+
+cm_internal u64
+cm__disk_table_bucket(u64 key, u64 mask) {
+	return CM_HASH_FIB64(key) & mask;
+}
+
+b32
+cm_disk_table_open(cmDiskTable *t, char const *filename) {
+	cmDiskTableHeader h;
+	u64 buckets_end, entries_end;
+	cm_zero_item(t);
+	if (!cm__mapped_file_open(&t->file, filename, -1))
+		return false;
+	if (t->file.size < cm_size_of(cmDiskTableHeader))
+		goto invalid;
+
+	cm_memcopy(&h, t->file.data, cm_size_of(h));
+	h.version        = le32toh(h.version);
+	h.value_size     = le32toh(h.value_size);
+	h.bucket_count   = le64toh(h.bucket_count);
+	h.entry_count    = le64toh(h.entry_count);
+	h.entry_size     = le64toh(h.entry_size);
+	h.buckets_offset = le64toh(h.buckets_offset);
+	h.entries_offset = le64toh(h.entries_offset);
+	h.file_size      = le64toh(h.file_size);
+
+	if (cm_memcompare(h.magic, CM_DISK_TABLE_MAGIC, 8) != 0 || h.version != CM_DISK_TABLE_VERSION)
+		goto invalid;
+	if (h.bucket_count == 0 || (h.bucket_count & (h.bucket_count - 1)) != 0)
+		goto invalid;
+	if (h.entry_size != cast(u64)cm__disk_table_entry_size(h.value_size) || h.file_size != cast(u64)t->file.size)
+		goto invalid;
+	if ((h.buckets_offset & 7) != 0 || (h.entries_offset & 7) != 0)
+		goto invalid;
+	// NOTE: The counts are bounded by the file size first so the products below cannot overflow
+	if (h.bucket_count > h.file_size / 8 || h.entry_count > h.file_size / h.entry_size)
+		goto invalid;
+	buckets_end = h.buckets_offset + (h.bucket_count + 1)*8;
+	entries_end = h.entries_offset + h.entry_count*h.entry_size;
+	if (h.buckets_offset < sizeof(h) || buckets_end > h.file_size ||
+	    h.entries_offset < buckets_end || entries_end > h.file_size)
+		goto invalid;
+
+	t->buckets    = cast(u64 const *)(t->file.data + h.buckets_offset);
+	t->entries    = t->file.data + h.entries_offset;
+	t->mask       = h.bucket_count - 1;
+	t->count      = cast(isize)h.entry_count;
+	t->entry_size = cast(isize)h.entry_size;
+	t->value_size = cast(isize)h.value_size;
+	return true;
+
+invalid:
+	cm__mapped_file_close(&t->file, -1);
+	return false;
+}
+
+void
+cm_disk_table_close(cmDiskTable *t) {
+	if (t->file.data)
+		cm__mapped_file_close(&t->file, -1);
+	cm_zero_item(t);
+}
+
+void const *
+cm_disk_table_get(cmDiskTable const *t, u64 key) {
+	u64 b = cm__disk_table_bucket(key, t->mask);
+	u64 i = le64toh(t->buckets[b]), end = le64toh(t->buckets[b+1]);
+	// NOTE: Offsets from a damaged file are clamped rather than trusted
+	end = CM_MIN(end, cast(u64)t->count);
+	for (; i < end; i++) {
+		u8 const *e = t->entries + i*t->entry_size;
+		if (le64toh(*cast(u64 const *)e) == key)
+			return e + cm_size_of(u64);
+	}
+	return NULL;
+}
+
+
+b32
+cm_disk_table_write_begin(cmDiskTableWriter *w, char const *filename, isize value_size, isize capacity) {
+	isize bucket_count = 1, entries_offset, file_size;
+	CM_ASSERT(value_size >= 0 && capacity >= 0);
+	cm_zero_item(w);
+	while (bucket_count < capacity)
+		bucket_count <<= 1;
+	w->entry_size = cm__disk_table_entry_size(value_size);
+	entries_offset = (cm_size_of(cmDiskTableHeader) + (bucket_count + 1)*8 + 63) & ~63;
+	file_size = entries_offset + capacity*w->entry_size;
+	// NOTE: A fresh file reads as zeros, so the bucket counts start out cleared
+	if (!cm__mapped_file_open(&w->file, filename, file_size))
+		return false;
+	w->buckets    = cast(u64 *)(w->file.data + cm_size_of(cmDiskTableHeader));
+	w->entries    = w->file.data + entries_offset;
+	w->mask       = bucket_count - 1;
+	w->capacity   = capacity;
+	w->value_size = value_size;
+	return true;
+}
+
+void
+cm_disk_table_write_add(cmDiskTableWriter *w, u64 key, void const *value) {
+	u8 *e;
+	CM_ASSERT_MSG(w->count < w->capacity, "More entries than the writer's capacity");
+	e = w->entries + w->count*w->entry_size;
+	*cast(u64 *)e = htole64(key);
+	cm_memcopy(e + cm_size_of(u64), value, w->value_size);
+	// NOTE: Counted one bucket along so the prefix sum in write_end leaves each bucket's start
+	w->buckets[cm__disk_table_bucket(key, w->mask) + 1]++;
+	w->count++;
+}
+
+b32
+cm_disk_table_write_end(cmDiskTableWriter *w) {
+	cmDiskTableHeader h = {0};
+	isize bucket_count = cast(isize)w->mask + 1, b;
+	isize entries_offset = w->entries - w->file.data;
+	u64 *cursors;
+	u8 *tmp;
+	b32 ok;
+
+	for (b = 1; b <= bucket_count; b++)
+		w->buckets[b] += w->buckets[b-1];
+
+	// NOTE: In place counting sort into bucket order, each swap puts one more entry in its bucket
+	cursors = cast(u64 *)cm_alloc(cm_heap_allocator(), bucket_count*cm_size_of(u64) + w->entry_size);
+	tmp = cast(u8 *)(cursors + bucket_count);
+	cm_memcopy(cursors, w->buckets, bucket_count*cm_size_of(u64));
+	for (b = 0; b < bucket_count; b++) {
+		while (cursors[b] < w->buckets[b+1]) {
+			u8 *e = w->entries + cursors[b]*w->entry_size;
+			u64 t = cm__disk_table_bucket(le64toh(*cast(u64 *)e), w->mask);
+			if (t == cast(u64)b) {
+				cursors[b]++;
+			} else {
+				u8 *other = w->entries + cursors[t]*w->entry_size;
+				cm_memcopy(tmp,   e,     w->entry_size);
+				cm_memcopy(e,     other, w->entry_size);
+				cm_memcopy(other, tmp,   w->entry_size);
+				cursors[t]++;
+			}
+		}
+	}
+	cm_free(cm_heap_allocator(), cursors);
+
+	for (b = 0; b <= bucket_count; b++)
+		w->buckets[b] = htole64(w->buckets[b]);
+
+	cm_memcopy(h.magic, CM_DISK_TABLE_MAGIC, 8);
+	h.version        = htole32(CM_DISK_TABLE_VERSION);
+	h.value_size     = htole32(cast(u32)w->value_size);
+	h.bucket_count   = htole64(cast(u64)bucket_count);
+	h.entry_count    = htole64(cast(u64)w->count);
+	h.entry_size     = htole64(cast(u64)w->entry_size);
+	h.buckets_offset = htole64(cm_size_of(cmDiskTableHeader));
+	h.entries_offset = htole64(cast(u64)entries_offset);
+	h.file_size      = htole64(cast(u64)(entries_offset + w->count*w->entry_size));
+	cm_memcopy(w->file.data, &h, cm_size_of(h));
+
+	ok = cm__mapped_file_close(&w->file, entries_offset + w->count*w->entry_size);
+	cm_zero_item(w);
+	return ok;
+}
+
+b32
+cm_disk_table_write_entries(char const *filename, void const *entries, isize count, isize stride,
+                            isize key_offset, isize value_offset, isize value_size) {
+	cmDiskTableWriter w;
+	isize i;
+	if (!cm_disk_table_write_begin(&w, filename, value_size, count))
+		return false;
+	for (i = 0; i < count; i++) {
+		u8 const *e = cast(u8 const *)entries + i*stride;
+		cm_disk_table_write_add(&w, *cast(u64 const *)(e + key_offset), e + value_offset);
+	}
+	return cm_disk_table_write_end(&w);
+}
@@ -0,0 +1,130 @@
+/********************************************************************************
+ * MIT License
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Copyright (c) 2020 Sarayu Nhookeaw
+ *
+ ********************************************************************************/
+
+#ifndef CM_DISKTABLE_H
+#define CM_DISKTABLE_H
+
+#include "memory.h"
+#include "hash.h"
+
+CM_BEGIN_EXTERN
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// On Disk Hash Table
+//
+// An immutable u64 keyed table stored in a file that is used straight from a read only
+// mapping: opening it only checks the header, each lookup touches the pages it needs and
+// every process mapping the file shares them through the page cache.
+//
+// The file, every field little-endian:
+//
+//     cmDiskTableHeader   64 bytes
+//     buckets             bucket_count+1 u64s, bucket b holds entries [buckets[b], buckets[b+1])
+//     entries             at entries_offset (64 byte aligned), entry_count entries of
+//                         entry_size bytes: the u64 key, then value_size bytes of value
+//                         zero padded to 8
+//
+// bucket_count is a power of two and a key's bucket is CM_HASH_FIB64(key) & (bucket_count-1),
+// that is part of the format. Entries are grouped by bucket so a lookup reads one pair of
+// bucket offsets and a short run of entries, there are no chains.
+//
+// NOTE: Values are stored as the bytes given. Write them little-endian (htole64 etc. from
+// endian.h) if the file will be read on a big-endian machine.
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+#define CM_DISK_TABLE_MAGIC   "cmDTable"
+#define CM_DISK_TABLE_VERSION 1
+
+typedef struct cmDiskTableHeader {
+	u8  magic[8];
+	u32 version;
+	u32 value_size;
+	u64 bucket_count;
+	u64 entry_count;
+	u64 entry_size;
+	u64 buckets_offset;
+	u64 entries_offset;
+	u64 file_size;
+} cmDiskTableHeader;
+
+CM_STATIC_ASSERT(sizeof(cmDiskTableHeader) == 64);
+
+typedef struct cmMappedFile {
+	u8 *  data;
+	isize size;
+#if defined(CM_SYS_WINDOWS)
+	void *win32_file;
+	void *win32_mapping;
+#else
+	int   posix_fd;
+#endif
+} cmMappedFile;
+
+typedef struct cmDiskTable {
+	cmMappedFile file;
+	u64 const *  buckets;
+	u8 const *   entries;
+	u64          mask;
+	isize        count;
+	isize        entry_size;
+	isize        value_size;
+} cmDiskTable;
+
+// NOTE: Checks the header and the sizes against the file, nothing else is read
+CM_DEF b32         cm_disk_table_open (cmDiskTable *t, char const *filename);
+CM_DEF void        cm_disk_table_close(cmDiskTable *t);
+// NOTE: Points at the value inside the mapping, NULL if the key is missing
+CM_DEF void const *cm_disk_table_get  (cmDiskTable const *t, u64 key);
+
+
+// NOTE: Writes a table in place through a writable mapping of the output file, so the only
+// memory used is a cursor per bucket when the entries are put in bucket order at the end.
+// Entries may be added in any order, e.g. straight from a sorted key/value stream, but each
+// key must only be added once. The header is written last, an unfinished file never opens.
+// Write to a temporary name and cm_file_move it over the old table to replace one that
+// readers have mapped.
+typedef struct cmDiskTableWriter {
+	cmMappedFile file;
+	u64 *        buckets;
+	u8 *         entries;
+	u64          mask;
+	isize        capacity;
+	isize        count;
+	isize        entry_size;
+	isize        value_size;
+} cmDiskTableWriter;
+
+// NOTE: capacity is the most entries that will be added
+CM_DEF b32  cm_disk_table_write_begin(cmDiskTableWriter *w, char const *filename, isize value_size, isize capacity);
+CM_DEF void cm_disk_table_write_add  (cmDiskTableWriter *w, u64 key, void const *value);
+CM_DEF b32  cm_disk_table_write_end  (cmDiskTableWriter *w);
+
+// NOTE: Writes `count` entries of `stride` bytes, each with a u64 key and value_size bytes of
+// value at the given offsets
+CM_DEF b32 cm_disk_table_write_entries(char const *filename, void const *entries, isize count, isize stride,
+                                       isize key_offset, isize value_offset, isize value_size);
+
+// NOTE: Writes a CM_TABLE (or any table instantiated with u64 keys) to `filename`
+#define cm_disk_table_write_table(filename, h) \
+	cm_disk_table_write_entries((filename), (h)->entries, cm_array_count((h)->entries), cm_size_of((h)->entries[0]), \
+	                            cast(isize)(cast(u8 *)&(h)->entries[0].key   - cast(u8 *)&(h)->entries[0]), \
+	                            cast(isize)(cast(u8 *)&(h)->entries[0].value - cast(u8 *)&(h)->entries[0]), \
+	                            cm_size_of((h)->entries[0].value))
+
+CM_END_EXTERN
+
+#endif //CM_DISKTABLE_H
@@ -15,6 +15,30 @@
 
 #include "dynarray.h"
 
+void *
+cm__array_init(cmAllocator a, isize capacity, isize element_size, isize alignment) {
+	isize padded, size;
+	u8 *block;
+	cmArrayHeader *h;
+
+	CM_ASSERT(element_size > 0);
+	CM_ASSERT(cm_is_power_of_two(alignment));
+
+	// NOTE: Never below the default so the header itself stays aligned
+	if (alignment < CM_DEFAULT_MEMORY_ALIGNMENT)
+		alignment = CM_DEFAULT_MEMORY_ALIGNMENT;
+
+	padded = CM_ARRAY_HEADER_PADDED_SIZE(alignment);
+	size   = padded + element_size*capacity;
+	block  = cast(u8 *)cm_alloc_align(a, size, alignment);
+	h      = cast(cmArrayHeader *)(block + padded) - 1;
+	h->allocator = a;
+	h->count     = 0;
+	h->capacity  = (cm_usable_size(a, block, size) - padded) / element_size;
+	h->alignment = alignment;
+	return h+1;
+}
+
 cm_no_inline void *
 cm__array_set_capacity(void *array, isize capacity, isize element_size) {
 
@@ -36,13 +60,18 @@ cm__array_set_capacity(void *array, isize capacity, isize element_size) {
 	}
 
 	{
-		isize size = cm_size_of(cmArrayHeader) + element_size*capacity;
-		cmArrayHeader *nh = cast(cmArrayHeader *)cm_alloc(h->allocator, size);
-		cm_memmove(nh, h, cm_size_of(cmArrayHeader) + element_size*h->count);
-		nh->allocator = h->allocator;
-		nh->count     = h->count;
-		nh->capacity  = capacity;
-		cm_free(h->allocator, h);
+		// NOTE: Resize so allocators that can grow a block in place (e.g. the top of an arena) get to.
+		// The padding in front of the header is the same for the new block, as the alignment is.
+		isize alignment = h->alignment;
+		isize padded    = CM_ARRAY_HEADER_PADDED_SIZE(alignment);
+		isize old_size  = padded + element_size*h->capacity;
+		isize size      = padded + element_size*capacity;
+		cmAllocator a   = h->allocator;
+		u8 *block = cast(u8 *)cm_resize_align(a, cast(u8 *)array - padded, old_size, size, alignment);
+		cmArrayHeader *nh = cast(cmArrayHeader *)(block + padded) - 1;
+		nh->allocator = a;
+		nh->capacity  = (cm_usable_size(a, block, size) - padded) / element_size;
+		nh->alignment = alignment;
 		return nh+1;
 	}
 }
@@ -34,6 +34,7 @@ CM_BEGIN_EXTERN
 //
 // Available Procedures for cmArray(Type)
 // cm_array_init
+// cm_array_init_align
 // cm_array_free
 // cm_array_set_capacity
 // cm_array_grow
@@ -88,6 +89,7 @@ typedef struct cmArrayHeader {
 	cmAllocator allocator;
 	isize       count;
 	isize       capacity;
+	isize       alignment; // NOTE: Of element 0, kept through every resize
 } cmArrayHeader;
 
 // NOTE(bill): This thing is magic!
@@ -104,22 +106,27 @@ CM_STATIC_ASSERT(CM_ARRAY_GROW_FORMULA(0) > 0);
 #define cm_array_count(x)     (CM_ARRAY_HEADER(x)->count)
 #define cm_array_capacity(x)  (CM_ARRAY_HEADER(x)->capacity)
 
-// TODO(bill): Have proper alignment!
-#define cm_array_init_reserve(x, allocator_, cap) do { \
+// NOTE: The block is laid out as [padding][cmArrayHeader][elements...] with the padding sized so
+// element 0 starts on `alignment`, so CM_ARRAY_HEADER still finds the header right before it.
+// Use a 32 or 64 byte alignment for arrays that are loaded with aligned SIMD loads.
+#define CM_ARRAY_HEADER_PADDED_SIZE(alignment) \
+	((cm_size_of(cmArrayHeader) + (alignment) - 1) & ~((alignment) - 1))
+
+// NOTE: The capacity includes any slack the allocator rounded the block up with
+#define cm_array_init_reserve_align(x, allocator_, cap, alignment_) do { \
 	void **cm__array_ = cast(void **)&(x); \
-	cmArrayHeader *cm__ah = cast(cmArrayHeader *)cm_alloc(allocator_, cm_size_of(cmArrayHeader)+cm_size_of(*(x))*(cap)); \
-	cm__ah->allocator = allocator_; \
-	cm__ah->count = 0; \
-	cm__ah->capacity = cap; \
-	*cm__array_ = cast(void *)(cm__ah+1); \
+	*cm__array_ = cm__array_init((allocator_), (cap), cm_size_of(*(x)), (alignment_)); \
 } while (0)
 
+#define cm_array_init_reserve(x, allocator_, cap) cm_array_init_reserve_align(x, allocator_, cap, CM_DEFAULT_MEMORY_ALIGNMENT)
+
 // NOTE(bill): Give it an initial default capacity
 #define cm_array_init(x, allocator) cm_array_init_reserve(x, allocator, CM_ARRAY_GROW_FORMULA(0))
+#define cm_array_init_align(x, allocator, alignment) cm_array_init_reserve_align(x, allocator, CM_ARRAY_GROW_FORMULA(0), alignment)
 
 #define cm_array_free(x) do { \
 	cmArrayHeader *cm__ah = CM_ARRAY_HEADER(x); \
-	cm_free(cm__ah->allocator, cm__ah); \
+	cm_free(cm__ah->allocator, cast(u8 *)(x) - CM_ARRAY_HEADER_PADDED_SIZE(cm__ah->alignment)); \
 } while (0)
 
 #define cm_array_set_capacity(x, capacity) do { \
@@ -129,7 +136,8 @@ CM_STATIC_ASSERT(CM_ARRAY_GROW_FORMULA(0) > 0);
 	} \
 } while (0)
 
-// NOTE(bill): Do not use the thing below directly, use the macro
+// NOTE(bill): Do not use the things below directly, use the macros
+CM_DEF void *cm__array_init        (cmAllocator a, isize capacity, isize element_size, isize alignment);
 CM_DEF void *cm__array_set_capacity(void *array, isize capacity, isize element_size);
 
 
@@ -151,8 +159,10 @@ CM_DEF void *cm__array_set_capacity(void *array, isize capacity, isize element_s
 #define cm_array_appendv(x, items, item_count) do { \
 	cmArrayHeader *cm__ah = CM_ARRAY_HEADER(x); \
 	CM_ASSERT(cm_size_of((items)[0]) == cm_size_of((x)[0])); \
-	if (cm__ah->capacity < cm__ah->count+(item_count)) \
+	if (cm__ah->capacity < cm__ah->count+(item_count)) { \
 		cm_array_grow(x, cm__ah->count+(item_count)); \
+		cm__ah = CM_ARRAY_HEADER(x); \
+	} \
 	cm_memcopy(&(x)[cm__ah->count], (items), cm_size_of((x)[0])*(item_count));\
 	cm__ah->count += (item_count); \
 } while (0)
@@ -43,6 +43,18 @@ CM_EXTERN u64 cm_murmur64(void const *data, isize len);
 CM_EXTERN u32 cm_murmur32_seed(void const *data, isize len, u32 seed);
 CM_EXTERN u64 cm_murmur64_seed(void const *data, isize len, u64 seed);
 
+// NOTE: MurmurHash3's 64-bit finalizer, every bit of `h` ends up affecting every other bit.
+// Updates `h` in place so macro instantiated code gets it without a function call.
+#define CM_HASH_MIX64(h) do { \
+	(h) ^= (h) >> 33; (h) *= 0xff51afd7ed558ccdull; \
+	(h) ^= (h) >> 33; (h) *= 0xc4ceb9fe1a85ec53ull; \
+	(h) ^= (h) >> 33; \
+} while (0)
+
+// NOTE: Fibonacci hashing with the high half folded down, so the low bits are mixed as
+// well as the high ones and the result can be masked. One multiply, `k` is evaluated twice.
+#define CM_HASH_FIB64(k) (((k) * 0x9e3779b97f4a7c15ull) ^ (((k) * 0x9e3779b97f4a7c15ull) >> 32))
+
 CM_END_EXTERN
 
 #endif
\ No newline at end of file
@@ -0,0 +1,159 @@
+/********************************************************************************
+ * MIT License
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Copyright (c) 2020 Sarayu Nhookeaw
+ *
+ ********************************************************************************/
+
+#include "hashtable.h"
+
+//
+// Hash Table
+//
+
+isize
+cm__table_pow2_count(isize count) {
+	isize n = 1;
+	if (count <= 0)
+		return 0;
+	while (n < count)
+		n <<= 1;
+	return n;
+}
+
+//
+// Keyed Hash Table
+//
+
+cm_inline cmByteSlice
+cm_byte_slice(void const *data, isize len) {
+	cmByteSlice s;
+	s.data = data;
+	s.len  = len;
+	return s;
+}
+
+u64
+cm_hash_table_string_hash(cmString key) {
+	return cm_murmur64(key, cm_string_length(key));
+}
+
+b32
+cm_hash_table_string_eq(cmString a, cmString b) {
+	isize len = cm_string_length(a);
+	return len == cm_string_length(b) && cm_memcompare(a, b, len) == 0;
+}
+
+u64
+cm_hash_table_bytes_hash(cmByteSlice key) {
+	return cm_murmur64(key.data, key.len);
+}
+
+b32
+cm_hash_table_bytes_eq(cmByteSlice a, cmByteSlice b) {
+	return a.len == b.len && cm_memcompare(a.data, b.data, a.len) == 0;
+}
+
+//
+// Flat Hash Table
+//
+
+u32
+cm__flat_group_match_scalar(i8 const *ctrl, i8 h2) {
+	u32 match = 0;
+	isize i;
+	for (i = 0; i < CM_FLAT_TABLE_GROUP_WIDTH; i++) {
+		if (ctrl[i] == h2)
+			match |= cast(u32)1 << i;
+	}
+	return match;
+}
+
+u32
+cm__flat_group_match_free_scalar(i8 const *ctrl) {
+	u32 match = 0;
+	isize i;
+	for (i = 0; i < CM_FLAT_TABLE_GROUP_WIDTH; i++) {
+		if (!cm_flat_table_is_full(ctrl[i]))
+			match |= cast(u32)1 << i;
+	}
+	return match;
+}
+
+isize
+cm__flat_first_bit_scalar(u32 mask) {
+	isize i = 0;
+	CM_ASSERT(mask != 0);
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		i++;
+	}
+	return i;
+}
+
+b32
+cm__flat_table_can_empty(i8 const *ctrl, isize index, isize mask) {
+	// NOTE: Every probe window holding `index` is 16 slots wide. If the empty slots closest
+	// to it on either side are less than 16 apart, each of those windows had an empty slot
+	// and no probe ever went on past it.
+	u32 empty_before = cm__flat_group_match_empty(ctrl + ((index - CM_FLAT_TABLE_GROUP_WIDTH) & mask));
+	u32 empty_after  = cm__flat_group_match_empty(ctrl + index);
+	isize after, before, i;
+	if (empty_before == 0 || empty_after == 0)
+		return false;
+	after = cm__flat_first_bit(empty_after);
+	for (i = CM_FLAT_TABLE_GROUP_WIDTH-1; (empty_before & (cast(u32)1 << i)) == 0; i--)
+		;
+	before = CM_FLAT_TABLE_GROUP_WIDTH-1 - i;
+	return after + before < CM_FLAT_TABLE_GROUP_WIDTH;
+}
+
+//
+// Concurrent Hash Table
+//
+
+b32
+cm__concurrent_table_lock(cmAtomic32 volatile *version) {
+	for (;;) {
+		i32 v = cm_atomic32_load(version);
+		if (v & CM_CONCURRENT_TABLE_FROZEN)
+			return false;
+		if ((v & CM_CONCURRENT_TABLE_LOCKED) == 0 &&
+		    cm_atomic32_compare_exchange(version, v, v | CM_CONCURRENT_TABLE_LOCKED) == v)
+			return true;
+		cm_yield_thread();
+	}
+}
+
+b32
+cm__concurrent_table_try_lock(cmAtomic32 volatile *version) {
+	i32 v = cm_atomic32_load(version);
+	return (v & (CM_CONCURRENT_TABLE_LOCKED | CM_CONCURRENT_TABLE_FROZEN)) == 0 &&
+	       cm_atomic32_compare_exchange(version, v, v | CM_CONCURRENT_TABLE_LOCKED) == v;
+}
+
+void
+cm__concurrent_table_unlock(cmAtomic32 volatile *version) {
+	// NOTE: The full barrier makes the bucket writes visible before the new version
+	i32 v = cm_atomic32_load(version);
+	cm_atomic32_exchanged(version, cast(i32)((cast(u32)v & ~3u) + 4));
+}
+
+void
+cm__concurrent_table_freeze(cmAtomic32 volatile *version) {
+	for (;;) {
+		i32 v = cm_atomic32_load(version);
+		if ((v & CM_CONCURRENT_TABLE_LOCKED) == 0 &&
+		    cm_atomic32_compare_exchange(version, v, v | CM_CONCURRENT_TABLE_FROZEN) == v)
+			return;
+		cm_yield_thread();
+	}
+}
@@ -18,6 +18,10 @@
 
 #include "memory.h"
 #include "dynarray.h"
+#include "hash.h"
+#include "string.h"
+#include "atomics.h"
+#include "fences.h"
 
 CM_BEGIN_EXTERN
 
@@ -27,6 +31,21 @@ CM_BEGIN_EXTERN
 //
 // This is an attempt to implement a templated hash table
 // NOTE(bill): The key is aways a u64 for simplicity and you will _probably_ _never_ need anything bigger.
+// NOTE: For any other key type use CM_TABLE_KEYED, CM_STRING_TABLE or CM_BYTES_TABLE below.
+//
+// The bucket is `key % bucket count`, which is a division per lookup and keeps patterned
+// keys (pointers, IDs with a stride) patterned. CM_TABLE_POW2 instead mixes the key with
+// CM_HASH_FIB64 once, caches that, and masks it into a power of two bucket count.
+//
+// Growing is incremental: the old bucket array is kept and each get/set/remove moves
+// CM_TABLE_REHASH_STEP of its buckets over, so no single call pays for the whole table.
+// Call FUNC##rehash_step when idle to finish early, it returns false once done.
+// FUNC##rehash still rebuilds every bucket at once.
+//
+// FUNC##get_batch looks up many keys at once, storing each value pointer (or NULL) in
+// `values` and returning how many were found. It works through CM_TABLE_BATCH_GROUP keys
+// at a time, prefetching all their buckets and then all their first entries before
+// walking any chain, so the cache misses of a group overlap instead of queueing.
 //
 // Hash table type and function declaration, call: CM_TABLE_DECLARE(PREFIX, NAME, N, VALUE)
 // Hash table function definitions, call: CM_TABLE_DEFINE(NAME, N, VALUE)
@@ -40,66 +59,163 @@ CM_BEGIN_EXTERN
 //
 /////////////////////////////////////////////////////////////////////////////////
 
+// NOTE: Old buckets migrated by each get/set/remove while a table grows
+#ifndef CM_TABLE_REHASH_STEP
+#define CM_TABLE_REHASH_STEP 8
+#endif
+
+// NOTE: Keys FUNC##get_batch hashes and prefetches before it walks any of their chains
+#ifndef CM_TABLE_BATCH_GROUP
+#define CM_TABLE_BATCH_GROUP 16
+#endif
+
 typedef struct cmHashTableFindResult {
 	isize hash_index;
 	isize entry_prev;
 	isize entry_index;
 } cmHashTableFindResult;
 
+#define cm__table_u64_hash(key)     (key)
+#define cm__table_u64_fib_hash(key) CM_HASH_FIB64(key)
+#define cm__table_u64_eq(a, b)      ((a) == (b))
+
+// NOTE: Bucket sizing, SIZING is pasted onto these. `mod` takes any count and the hash
+// modulo it, `pow2` rounds counts up to a power of two and masks the hash.
+#define cm__table_count_mod(count)        (count)
+#define cm__table_index_mod(hash, count)  cast(isize)((hash) % cast(u64)(count))
+#define cm__table_count_pow2(count)       cm__table_pow2_count(count)
+#define cm__table_index_pow2(hash, count) cast(isize)((hash) & cast(u64)((count) - 1))
+
+CM_DEF isize cm__table_pow2_count(isize count); // NOTE: 0 stays 0
+
 #define CM_TABLE(PREFIX, NAME, FUNC, VALUE) \
 	CM_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE); \
 	CM_TABLE_DEFINE(NAME, FUNC, VALUE);
 
 #define CM_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, u64, VALUE)
+
+#define CM_TABLE_DEFINE(NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_DEFINE(NAME, FUNC, u64, VALUE, cm__table_u64_hash, cm__table_u64_eq)
+
+#define CM_TABLE_POW2(PREFIX, NAME, FUNC, VALUE) \
+	CM_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE); \
+	CM_TABLE_POW2_DEFINE(NAME, FUNC, VALUE);
+
+#define CM_TABLE_POW2_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+	CM_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE)
+
+#define CM_TABLE_POW2_DEFINE(NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_POW2_DEFINE(NAME, FUNC, u64, VALUE, cm__table_u64_fib_hash, cm__table_u64_eq)
+
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// Instantiated Hash Table with any Key
+//
+// The same table for keys of any type. Each entry keeps the key's hash next to it, so
+// lookups only call EQ when the full 64-bit hashes match and rehashing never calls HASH.
+// Keys are stored by value, a key that points at memory (strings, slices) must outlive
+// its entry.
+//
+// Hash table type and function declaration, call: CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, KEY, VALUE)
+// Hash table function definitions, call: CM_TABLE_KEYED_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ)
+//                                    or: CM_TABLE_KEYED_POW2_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ)
+//
+// The POW2 variant masks the hash into a power of two bucket count instead of taking it
+// modulo the count, so HASH must mix its low bits well. The string and byte slice tables
+// use it since their hash is cm_murmur64.
+//
+//     KEY     - the type of the key
+//     HASH    - function or macro, u64 HASH(KEY key)
+//     EQ      - function or macro, b32 EQ(KEY a, KEY b)
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+#define CM_TABLE_KEYED(PREFIX, NAME, FUNC, KEY, VALUE, HASH, EQ) \
+	CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, KEY, VALUE); \
+	CM_TABLE_KEYED_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ);
+
+#define CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, KEY, VALUE) \
 typedef struct CM_JOIN2(NAME,Entry) { \
-	u64 key; \
+	KEY key; \
+	u64 hash; \
 	isize next; \
 	VALUE value; \
 } CM_JOIN2(NAME,Entry); \
 \
 typedef struct NAME { \
 	cmArray(isize) hashes; \
+	cmArray(isize) old_hashes;   /* NOTE: Buckets still being migrated, NULL otherwise */ \
+	isize          rehash_index; /* NOTE: Next old bucket to migrate */ \
 	cmArray(CM_JOIN2(NAME,Entry)) entries; \
 } NAME; \
 \
 PREFIX void                  CM_JOIN2(FUNC,init)       (NAME *h, cmAllocator a); \
 PREFIX void                  CM_JOIN2(FUNC,destroy)    (NAME *h); \
-PREFIX VALUE *               CM_JOIN2(FUNC,get)        (NAME *h, u64 key); \
-PREFIX void                  CM_JOIN2(FUNC,set)        (NAME *h, u64 key, VALUE value); \
+PREFIX VALUE *               CM_JOIN2(FUNC,get)        (NAME *h, KEY key); \
+PREFIX isize                 CM_JOIN2(FUNC,get_batch)  (NAME *h, KEY const *keys, isize count, VALUE **values); \
+PREFIX void                  CM_JOIN2(FUNC,set)        (NAME *h, KEY key, VALUE value); \
+PREFIX b32                   CM_JOIN2(FUNC,remove)     (NAME *h, KEY key); \
 PREFIX void                  CM_JOIN2(FUNC,grow)       (NAME *h); \
 PREFIX void                  CM_JOIN2(FUNC,rehash)     (NAME *h, isize new_count); \
+PREFIX b32                   CM_JOIN2(FUNC,rehash_step)(NAME *h, isize bucket_count); \
 
-#define CM_TABLE_DEFINE(NAME, FUNC, VALUE) \
+#define CM_TABLE_KEYED_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ) \
+	CM__TABLE_KEYED_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ, mod)
+
+#define CM_TABLE_KEYED_POW2(PREFIX, NAME, FUNC, KEY, VALUE, HASH, EQ) \
+	CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, KEY, VALUE); \
+	CM_TABLE_KEYED_POW2_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ);
+
+#define CM_TABLE_KEYED_POW2_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ) \
+	CM__TABLE_KEYED_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ, pow2)
+
+#define CM__TABLE_KEYED_DEFINE(NAME, FUNC, KEY, VALUE, HASH, EQ, SIZING) \
 void CM_JOIN2(FUNC,init)(NAME *h, cmAllocator a) { \
 	cm_array_init(h->hashes,  a); \
 	cm_array_init(h->entries, a); \
+	h->old_hashes   = NULL; \
+	h->rehash_index = 0; \
 } \
 \
 void CM_JOIN2(FUNC,destroy)(NAME *h) { \
-	if (h->entries) cm_array_free(h->entries); \
-	if (h->hashes)  cm_array_free(h->hashes); \
+	if (h->entries)    cm_array_free(h->entries); \
+	if (h->hashes)     cm_array_free(h->hashes); \
+	if (h->old_hashes) cm_array_free(h->old_hashes); \
 } \
 \
-cm_internal isize CM_JOIN2(FUNC,_add_entry)(NAME *h, u64 key) { \
+cm_internal isize CM_JOIN2(FUNC,_add_entry)(NAME *h, KEY key, u64 hash) { \
 	isize index; \
 	CM_JOIN2(NAME,Entry) e = {0}; \
 	e.key = key; \
+	e.hash = hash; \
 	e.next = -1; \
 	index = cm_array_count(h->entries); \
 	cm_array_append(h->entries, e); \
 	return index; \
 } \
 \
-cm_internal cmHashTableFindResult CM_JOIN2(FUNC,_find)(NAME *h, u64 key) { \
+/* NOTE: While migrating, a hash lives in its old bucket until that bucket has been moved */ \
+cm_internal isize *CM_JOIN2(FUNC,_buckets)(NAME *h, u64 hash) { \
+	if (h->old_hashes && CM_JOIN2(cm__table_index_,SIZING)(hash, cm_array_count(h->old_hashes)) >= h->rehash_index) \
+		return h->old_hashes; \
+	return h->hashes; \
+} \
+\
+/* NOTE: hash_index is into the buckets returned by _buckets for the same hash */ \
+cm_internal cmHashTableFindResult CM_JOIN2(FUNC,_find)(NAME *h, KEY key, u64 hash) { \
 	cmHashTableFindResult r = {-1, -1, -1}; \
-	if (cm_array_count(h->hashes) > 0) { \
-		r.hash_index  = key % cm_array_count(h->hashes); \
-		r.entry_index = h->hashes[r.hash_index]; \
+	isize *buckets = CM_JOIN2(FUNC,_buckets)(h, hash); \
+	if (cm_array_count(buckets) > 0) { \
+		r.hash_index  = CM_JOIN2(cm__table_index_,SIZING)(hash, cm_array_count(buckets)); \
+		r.entry_index = buckets[r.hash_index]; \
 		while (r.entry_index >= 0) { \
-			if (h->entries[r.entry_index].key == key) \
+			CM_JOIN2(NAME,Entry) *e = &h->entries[r.entry_index]; \
+			if (e->hash == hash && EQ(e->key, key)) \
 				return r; \
 			r.entry_prev = r.entry_index; \
-			r.entry_index = h->entries[r.entry_index].next; \
+			r.entry_index = e->next; \
 		} \
 	} \
 	return r; \
@@ -109,68 +225,806 @@ cm_internal b32 CM_JOIN2(FUNC,_full)(NAME *h) { \
 	return 0.75f * cm_array_count(h->hashes) < cm_array_count(h->entries); \
 } \
 \
+b32 CM_JOIN2(FUNC,rehash_step)(NAME *h, isize bucket_count) { \
+	isize old_count, new_count; \
+	if (h->old_hashes == NULL) \
+		return false; \
+	old_count = cm_array_count(h->old_hashes); \
+	new_count = cm_array_count(h->hashes); \
+	for (; bucket_count > 0 && h->rehash_index < old_count; bucket_count--) { \
+		isize j = h->old_hashes[h->rehash_index++]; \
+		while (j >= 0) { \
+			CM_JOIN2(NAME,Entry) *e = &h->entries[j]; \
+			isize next = e->next; \
+			isize hash_index = CM_JOIN2(cm__table_index_,SIZING)(e->hash, new_count); \
+			e->next = h->hashes[hash_index]; \
+			h->hashes[hash_index] = j; \
+			j = next; \
+		} \
+	} \
+	if (h->rehash_index < old_count) \
+		return true; \
+	cm_array_free(h->old_hashes); \
+	h->old_hashes   = NULL; \
+	h->rehash_index = 0; \
+	return false; \
+} \
+\
+/* NOTE: Growing only swaps in the larger bucket array, the entries are moved over */ \
+/* CM_TABLE_REHASH_STEP buckets at a time by the following get/set/remove calls */ \
 void CM_JOIN2(FUNC,grow)(NAME *h) { \
-	isize new_count = CM_ARRAY_GROW_FORMULA(cm_array_count(h->entries)); \
-	CM_JOIN2(FUNC,rehash)(h, new_count); \
+	isize i, new_count = CM_JOIN2(cm__table_count_,SIZING)(CM_ARRAY_GROW_FORMULA(cm_array_count(h->entries))); \
+	CM_JOIN2(FUNC,rehash_step)(h, ISIZE_MAX); \
+	if (cm_array_count(h->entries) == 0) { \
+		CM_JOIN2(FUNC,rehash)(h, new_count); \
+		return; \
+	} \
+	h->old_hashes   = h->hashes; \
+	h->rehash_index = 0; \
+	cm_array_init_reserve(h->hashes, cm_array_allocator(h->old_hashes), new_count); \
+	cm_array_resize(h->hashes, new_count); \
+	for (i = 0; i < new_count; i++) \
+		h->hashes[i] = -1; \
+	CM_JOIN2(FUNC,rehash_step)(h, CM_TABLE_REHASH_STEP); \
 } \
 \
 void CM_JOIN2(FUNC,rehash)(NAME *h, isize new_count) { \
-	isize i, j; \
-	NAME nh = {0}; \
-	CM_JOIN2(FUNC,init)(&nh, cm_array_allocator(h->hashes)); \
-	cm_array_resize(nh.hashes, new_count); \
-	cm_array_reserve(nh.entries, cm_array_count(h->entries)); \
+	isize i; \
+	CM_JOIN2(FUNC,rehash_step)(h, ISIZE_MAX); \
+	new_count = CM_JOIN2(cm__table_count_,SIZING)(new_count); \
+	cm_array_resize(h->hashes, new_count); \
 	for (i = 0; i < new_count; i++) \
-		nh.hashes[i] = -1; \
+		h->hashes[i] = -1; \
+	if (new_count == 0) { \
+		CM_ASSERT(cm_array_count(h->entries) == 0); \
+		return; \
+	} \
 	for (i = 0; i < cm_array_count(h->entries); i++) { \
-		CM_JOIN2(NAME,Entry) *e; \
-		cmHashTableFindResult fr; \
-		if (cm_array_count(nh.hashes) == 0) \
-			CM_JOIN2(FUNC,grow)(&nh); \
-		e = &h->entries[i]; \
-		fr = CM_JOIN2(FUNC,_find)(&nh, e->key); \
-		j = CM_JOIN2(FUNC,_add_entry)(&nh, e->key); \
-		if (fr.entry_prev < 0) \
-			nh.hashes[fr.hash_index] = j; \
-		else \
-			nh.entries[fr.entry_prev].next = j; \
-		nh.entries[j].next = fr.entry_index; \
-		nh.entries[j].value = e->value; \
-		if (CM_JOIN2(FUNC,_full)(&nh)) \
-			CM_JOIN2(FUNC,grow)(&nh); \
+		CM_JOIN2(NAME,Entry) *e = &h->entries[i]; \
+		isize hash_index = CM_JOIN2(cm__table_index_,SIZING)(e->hash, new_count); \
+		e->next = h->hashes[hash_index]; \
+		h->hashes[hash_index] = i; \
 	} \
-	CM_JOIN2(FUNC,destroy)(h); \
-	h->hashes  = nh.hashes; \
-	h->entries = nh.entries; \
+	if (CM_JOIN2(FUNC,_full)(h)) \
+		CM_JOIN2(FUNC,grow)(h); \
 } \
 \
-VALUE *CM_JOIN2(FUNC,get)(NAME *h, u64 key) { \
-	isize index = CM_JOIN2(FUNC,_find)(h, key).entry_index; \
+VALUE *CM_JOIN2(FUNC,get)(NAME *h, KEY key) { \
+	isize index; \
+	if (h->old_hashes) \
+		CM_JOIN2(FUNC,rehash_step)(h, CM_TABLE_REHASH_STEP); \
+	index = CM_JOIN2(FUNC,_find)(h, key, HASH(key)).entry_index; \
 	if (index >= 0) \
 		return &h->entries[index].value; \
 	return NULL; \
 } \
 \
-void CM_JOIN2(FUNC,set)(NAME *h, u64 key, VALUE value) { \
+isize CM_JOIN2(FUNC,get_batch)(NAME *h, KEY const *keys, isize count, VALUE **values) { \
+	u64    hashes[CM_TABLE_BATCH_GROUP]; \
+	isize *heads [CM_TABLE_BATCH_GROUP]; \
+	isize  base, i, n, found = 0; \
+	if (h->old_hashes) \
+		CM_JOIN2(FUNC,rehash_step)(h, CM_TABLE_REHASH_STEP); \
+	if (cm_array_count(h->hashes) == 0) { \
+		for (i = 0; i < count; i++) \
+			values[i] = NULL; \
+		return 0; \
+	} \
+	for (base = 0; base < count; base += CM_TABLE_BATCH_GROUP) { \
+		n = CM_MIN(count - base, CM_TABLE_BATCH_GROUP); \
+		for (i = 0; i < n; i++) { \
+			isize *buckets; \
+			hashes[i] = HASH(keys[base + i]); \
+			buckets   = CM_JOIN2(FUNC,_buckets)(h, hashes[i]); \
+			heads[i]  = &buckets[CM_JOIN2(cm__table_index_,SIZING)(hashes[i], cm_array_count(buckets))]; \
+			CM_PREFETCH(heads[i]); \
+		} \
+		for (i = 0; i < n; i++) { \
+			if (*heads[i] >= 0) \
+				CM_PREFETCH(&h->entries[*heads[i]]); \
+		} \
+		for (i = 0; i < n; i++) { \
+			isize j = *heads[i]; \
+			values[base + i] = NULL; \
+			while (j >= 0) { \
+				CM_JOIN2(NAME,Entry) *e = &h->entries[j]; \
+				if (e->hash == hashes[i] && EQ(e->key, keys[base + i])) { \
+					values[base + i] = &e->value; \
+					found++; \
+					break; \
+				} \
+				j = e->next; \
+			} \
+		} \
+	} \
+	return found; \
+} \
+\
+void CM_JOIN2(FUNC,set)(NAME *h, KEY key, VALUE value) { \
 	isize index; \
+	u64 hash = HASH(key); \
 	cmHashTableFindResult fr; \
 	if (cm_array_count(h->hashes) == 0) \
 		CM_JOIN2(FUNC,grow)(h); \
-	fr = CM_JOIN2(FUNC,_find)(h, key); \
+	else if (h->old_hashes) \
+		CM_JOIN2(FUNC,rehash_step)(h, CM_TABLE_REHASH_STEP); \
+	fr = CM_JOIN2(FUNC,_find)(h, key, hash); \
 	if (fr.entry_index >= 0) { \
 		index = fr.entry_index; \
 	} else { \
-		index = CM_JOIN2(FUNC,_add_entry)(h, key); \
+		index = CM_JOIN2(FUNC,_add_entry)(h, key, hash); \
 		if (fr.entry_prev >= 0) { \
 			h->entries[fr.entry_prev].next = index; \
 		} else { \
-			h->hashes[fr.hash_index] = index; \
+			CM_JOIN2(FUNC,_buckets)(h, hash)[fr.hash_index] = index; \
 		} \
 	} \
 	h->entries[index].value = value; \
 	if (CM_JOIN2(FUNC,_full)(h)) \
 		CM_JOIN2(FUNC,grow)(h); \
 } \
+\
+b32 CM_JOIN2(FUNC,remove)(NAME *h, KEY key) { \
+	isize last_index; \
+	u64 hash = HASH(key); \
+	cmHashTableFindResult fr; \
+	if (h->old_hashes) \
+		CM_JOIN2(FUNC,rehash_step)(h, CM_TABLE_REHASH_STEP); \
+	fr = CM_JOIN2(FUNC,_find)(h, key, hash); \
+	if (fr.entry_index < 0) \
+		return false; \
+	if (fr.entry_prev < 0) \
+		CM_JOIN2(FUNC,_buckets)(h, hash)[fr.hash_index] = h->entries[fr.entry_index].next; \
+	else \
+		h->entries[fr.entry_prev].next = h->entries[fr.entry_index].next; \
+	/* NOTE: Move the last entry into the hole and point its chain at the new index */ \
+	last_index = cm_array_count(h->entries) - 1; \
+	if (fr.entry_index != last_index) { \
+		cmHashTableFindResult last; \
+		u64 last_hash = h->entries[last_index].hash; \
+		h->entries[fr.entry_index] = h->entries[last_index]; \
+		last = CM_JOIN2(FUNC,_find)(h, h->entries[fr.entry_index].key, last_hash); \
+		if (last.entry_prev < 0) \
+			CM_JOIN2(FUNC,_buckets)(h, last_hash)[last.hash_index] = fr.entry_index; \
+		else \
+			h->entries[last.entry_prev].next = fr.entry_index; \
+	} \
+	cm_array_pop(h->entries); \
+	return true; \
+} \
+
+
+// NOTE: Specializations for cmString and byte slice keys, hashed with cm_murmur64
+typedef struct cmByteSlice {
+	void const *data;
+	isize       len;
+} cmByteSlice;
+
+CM_DEF cmByteSlice cm_byte_slice(void const *data, isize len);
+
+CM_DEF u64 cm_hash_table_string_hash(cmString key);
+CM_DEF b32 cm_hash_table_string_eq  (cmString a, cmString b);
+CM_DEF u64 cm_hash_table_bytes_hash (cmByteSlice key);
+CM_DEF b32 cm_hash_table_bytes_eq   (cmByteSlice a, cmByteSlice b);
+
+#define CM_STRING_TABLE(PREFIX, NAME, FUNC, VALUE) \
+	CM_STRING_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE); \
+	CM_STRING_TABLE_DEFINE(NAME, FUNC, VALUE);
+#define CM_STRING_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, cmString, VALUE)
+#define CM_STRING_TABLE_DEFINE(NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_POW2_DEFINE(NAME, FUNC, cmString, VALUE, cm_hash_table_string_hash, cm_hash_table_string_eq)
+
+#define CM_BYTES_TABLE(PREFIX, NAME, FUNC, VALUE) \
+	CM_BYTES_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE); \
+	CM_BYTES_TABLE_DEFINE(NAME, FUNC, VALUE);
+#define CM_BYTES_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_DECLARE(PREFIX, NAME, FUNC, cmByteSlice, VALUE)
+#define CM_BYTES_TABLE_DEFINE(NAME, FUNC, VALUE) \
+	CM_TABLE_KEYED_POW2_DEFINE(NAME, FUNC, cmByteSlice, VALUE, cm_hash_table_bytes_hash, cm_hash_table_bytes_eq)
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// Instantiated Flat Hash Table
+//
+// Open addressing table in the style of Swiss tables, for lookup heavy code. Every slot has
+// a control byte that is EMPTY, DELETED or, for a full slot, the low 7 bits of the key's
+// hash. A lookup compares 16 control bytes against those 7 bits at once and only looks at
+// the slots that match, so it usually costs one load of control bytes and one slot.
+// The capacity is a power of two, keys are mixed with CM_HASH_MIX64 first so patterned
+// keys still spread out. The table is kept at most 7/8 full.
+//
+// Flat hash table type and function declaration, call: CM_FLAT_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE)
+// Flat hash table function definitions, call: CM_FLAT_TABLE_DEFINE(NAME, FUNC, VALUE)
+//
+//     PREFIX  - a prefix for function prototypes e.g. extern, static, etc.
+//     NAME    - Name of the Hash Table
+//     FUNC    - the name will prefix function names
+//     VALUE   - the type of the value to be stored
+//
+// NOTE: Pointers returned by get are invalidated by set. To iterate:
+//	for (i = 0; i < h.capacity; i++)
+//		if (cm_flat_table_is_full(h.ctrl[i])) use(h.slots[i].key, h.slots[i].value);
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+#define CM_FLAT_TABLE_GROUP_WIDTH 16
+#define CM_FLAT_TABLE_MIN_CAPACITY CM_FLAT_TABLE_GROUP_WIDTH
+
+#define CM_FLAT_CTRL_EMPTY   (-128)
+#define CM_FLAT_CTRL_DELETED (-2)
+#define cm_flat_table_is_full(ctrl) ((ctrl) >= 0)
+
+// NOTE: Bit i of each mask is set when control byte i of the group at `ctrl` matches
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define cm__flat_group_match(ctrl, h2) \
+		cast(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _mm_loadu_si128(cast(__m128i const *)(ctrl))))
+	#define cm__flat_group_match_empty(ctrl) cm__flat_group_match(ctrl, CM_FLAT_CTRL_EMPTY)
+	// NOTE: EMPTY and DELETED are the control bytes with the sign bit set
+	#define cm__flat_group_match_free(ctrl) \
+		cast(u32)_mm_movemask_epi8(_mm_loadu_si128(cast(__m128i const *)(ctrl)))
+#else
+	#define cm__flat_group_match(ctrl, h2)   cm__flat_group_match_scalar(ctrl, h2)
+	#define cm__flat_group_match_empty(ctrl) cm__flat_group_match_scalar(ctrl, CM_FLAT_CTRL_EMPTY)
+	#define cm__flat_group_match_free(ctrl)  cm__flat_group_match_free_scalar(ctrl)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define cm__flat_first_bit(mask) cast(isize)__builtin_ctz(mask)
+#else
+	#define cm__flat_first_bit(mask) cm__flat_first_bit_scalar(mask)
+#endif
+
+CM_DEF u32   cm__flat_group_match_scalar     (i8 const *ctrl, i8 h2);
+CM_DEF u32   cm__flat_group_match_free_scalar(i8 const *ctrl);
+CM_DEF isize cm__flat_first_bit_scalar       (u32 mask);
+// NOTE: Whether a removed slot can go back to EMPTY, true when no probe could have passed over it
+CM_DEF b32   cm__flat_table_can_empty        (i8 const *ctrl, isize index, isize mask);
+
+#define CM_FLAT_TABLE(PREFIX, NAME, FUNC, VALUE) \
+	CM_FLAT_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE); \
+	CM_FLAT_TABLE_DEFINE(NAME, FUNC, VALUE);
+
+#define CM_FLAT_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+typedef struct CM_JOIN2(NAME,Slot) { \
+	u64 key; \
+	VALUE value; \
+} CM_JOIN2(NAME,Slot); \
+\
+typedef struct NAME { \
+	cmAllocator allocator; \
+	i8 *        ctrl; /* NOTE: capacity+CM_FLAT_TABLE_GROUP_WIDTH bytes, the extra ones mirror the first group */ \
+	CM_JOIN2(NAME,Slot) *slots; \
+	isize       capacity; \
+	isize       count; \
+	isize       growth_left; /* NOTE: Empty slots that may be filled before a rehash */ \
+} NAME; \
+\
+PREFIX void    CM_JOIN2(FUNC,init)   (NAME *h, cmAllocator a); \
+PREFIX void    CM_JOIN2(FUNC,destroy)(NAME *h); \
+PREFIX VALUE * CM_JOIN2(FUNC,get)    (NAME *h, u64 key); \
+PREFIX void    CM_JOIN2(FUNC,set)    (NAME *h, u64 key, VALUE value); \
+PREFIX b32     CM_JOIN2(FUNC,remove) (NAME *h, u64 key); \
+PREFIX void    CM_JOIN2(FUNC,clear)  (NAME *h); \
+PREFIX void    CM_JOIN2(FUNC,reserve)(NAME *h, isize count); \
+PREFIX void    CM_JOIN2(FUNC,rehash) (NAME *h, isize new_capacity); \
+
+#define CM_FLAT_TABLE_DEFINE(NAME, FUNC, VALUE) \
+void CM_JOIN2(FUNC,init)(NAME *h, cmAllocator a) { \
+	cm_zero_item(h); \
+	h->allocator = a; \
+} \
+\
+void CM_JOIN2(FUNC,destroy)(NAME *h) { \
+	if (h->ctrl) cm_free(h->allocator, h->ctrl); \
+	h->ctrl  = NULL; \
+	h->slots = NULL; \
+	h->capacity = h->count = h->growth_left = 0; \
+} \
+\
+cm_internal void CM_JOIN2(FUNC,_set_ctrl)(NAME *h, isize index, i8 c) { \
+	h->ctrl[index] = c; \
+	if (index < CM_FLAT_TABLE_GROUP_WIDTH) \
+		h->ctrl[h->capacity + index] = c; \
+} \
+\
+cm_internal isize CM_JOIN2(FUNC,_find)(NAME *h, u64 key, u64 hash) { \
+	isize mask = h->capacity - 1; \
+	isize pos  = cast(isize)(hash >> 7) & mask; \
+	isize step = 0; \
+	i8 h2 = cast(i8)(hash & 0x7f); \
+	for (;;) { \
+		i8 const *group = h->ctrl + pos; \
+		u32 match = cm__flat_group_match(group, h2); \
+		while (match) { \
+			isize index = (pos + cm__flat_first_bit(match)) & mask; \
+			if (h->slots[index].key == key) \
+				return index; \
+			match &= match - 1; \
+		} \
+		if (cm__flat_group_match_empty(group)) \
+			return -1; \
+		step += CM_FLAT_TABLE_GROUP_WIDTH; \
+		pos = (pos + step) & mask; \
+	} \
+} \
+\
+cm_internal isize CM_JOIN2(FUNC,_find_free)(NAME *h, u64 hash) { \
+	isize mask = h->capacity - 1; \
+	isize pos  = cast(isize)(hash >> 7) & mask; \
+	isize step = 0; \
+	for (;;) { \
+		u32 match = cm__flat_group_match_free(h->ctrl + pos); \
+		if (match) \
+			return (pos + cm__flat_first_bit(match)) & mask; \
+		step += CM_FLAT_TABLE_GROUP_WIDTH; \
+		pos = (pos + step) & mask; \
+	} \
+} \
+\
+void CM_JOIN2(FUNC,rehash)(NAME *h, isize new_capacity) { \
+	isize i, ctrl_size; \
+	NAME nh = *h; \
+	if (new_capacity < CM_FLAT_TABLE_MIN_CAPACITY) \
+		new_capacity = CM_FLAT_TABLE_MIN_CAPACITY; \
+	while (!cm_is_power_of_two(new_capacity)) \
+		new_capacity += new_capacity & -new_capacity; \
+	while (new_capacity - new_capacity/8 <= h->count) \
+		new_capacity *= 2; \
+	ctrl_size = (new_capacity + CM_FLAT_TABLE_GROUP_WIDTH + CM_DEFAULT_MEMORY_ALIGNMENT-1) & ~(CM_DEFAULT_MEMORY_ALIGNMENT-1); \
+	nh.ctrl = cast(i8 *)cm_alloc(h->allocator, ctrl_size + new_capacity*cm_size_of(CM_JOIN2(NAME,Slot))); \
+	nh.slots = cast(CM_JOIN2(NAME,Slot) *)(nh.ctrl + ctrl_size); \
+	nh.capacity = new_capacity; \
+	nh.growth_left = new_capacity - new_capacity/8 - h->count; \
+	cm_memset(nh.ctrl, cast(u8)CM_FLAT_CTRL_EMPTY, new_capacity + CM_FLAT_TABLE_GROUP_WIDTH); \
+	for (i = 0; i < h->capacity; i++) { \
+		if (cm_flat_table_is_full(h->ctrl[i])) { \
+			u64 hash = h->slots[i].key; \
+			isize j; \
+			CM_HASH_MIX64(hash); \
+			j = CM_JOIN2(FUNC,_find_free)(&nh, hash); \
+			CM_JOIN2(FUNC,_set_ctrl)(&nh, j, h->ctrl[i]); \
+			nh.slots[j] = h->slots[i]; \
+		} \
+	} \
+	if (h->ctrl) cm_free(h->allocator, h->ctrl); \
+	*h = nh; \
+} \
+\
+void CM_JOIN2(FUNC,reserve)(NAME *h, isize count) { \
+	if (count > h->count + h->growth_left) \
+		CM_JOIN2(FUNC,rehash)(h, count + count/7 + 1); \
+} \
+\
+void CM_JOIN2(FUNC,clear)(NAME *h) { \
+	if (h->capacity == 0) return; \
+	cm_memset(h->ctrl, cast(u8)CM_FLAT_CTRL_EMPTY, h->capacity + CM_FLAT_TABLE_GROUP_WIDTH); \
+	h->count = 0; \
+	h->growth_left = h->capacity - h->capacity/8; \
+} \
+\
+VALUE *CM_JOIN2(FUNC,get)(NAME *h, u64 key) { \
+	u64 hash = key; \
+	isize index; \
+	if (h->count == 0) \
+		return NULL; \
+	CM_HASH_MIX64(hash); \
+	index = CM_JOIN2(FUNC,_find)(h, key, hash); \
+	return index >= 0 ? &h->slots[index].value : NULL; \
+} \
+\
+void CM_JOIN2(FUNC,set)(NAME *h, u64 key, VALUE value) { \
+	u64 hash = key; \
+	isize index; \
+	CM_HASH_MIX64(hash); \
+	if (h->count > 0) { \
+		index = CM_JOIN2(FUNC,_find)(h, key, hash); \
+		if (index >= 0) { \
+			h->slots[index].value = value; \
+			return; \
+		} \
+	} \
+	if (h->capacity == 0) \
+		CM_JOIN2(FUNC,rehash)(h, CM_FLAT_TABLE_MIN_CAPACITY); \
+	index = CM_JOIN2(FUNC,_find_free)(h, hash); \
+	if (h->growth_left == 0 && h->ctrl[index] != CM_FLAT_CTRL_DELETED) { \
+		/* NOTE: Mostly tombstones means cleaning up at the same size is enough */ \
+		CM_JOIN2(FUNC,rehash)(h, h->count < h->capacity/2 ? h->capacity : 2*h->capacity); \
+		index = CM_JOIN2(FUNC,_find_free)(h, hash); \
+	} \
+	h->growth_left -= h->ctrl[index] == CM_FLAT_CTRL_EMPTY; \
+	CM_JOIN2(FUNC,_set_ctrl)(h, index, cast(i8)(hash & 0x7f)); \
+	h->slots[index].key   = key; \
+	h->slots[index].value = value; \
+	h->count++; \
+} \
+\
+b32 CM_JOIN2(FUNC,remove)(NAME *h, u64 key) { \
+	u64 hash = key; \
+	isize index; \
+	if (h->count == 0) \
+		return false; \
+	CM_HASH_MIX64(hash); \
+	index = CM_JOIN2(FUNC,_find)(h, key, hash); \
+	if (index < 0) \
+		return false; \
+	if (cm__flat_table_can_empty(h->ctrl, index, h->capacity - 1)) { \
+		CM_JOIN2(FUNC,_set_ctrl)(h, index, CM_FLAT_CTRL_EMPTY); \
+		h->growth_left++; \
+	} else { \
+		CM_JOIN2(FUNC,_set_ctrl)(h, index, CM_FLAT_CTRL_DELETED); \
+	} \
+	h->count--; \
+	return true; \
+} \
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// Instantiated Concurrent Hash Table
+//
+// A u64 keyed table that any number of threads may get/set/remove on at once. The table
+// is an array of buckets of CM_CONCURRENT_TABLE_BUCKET_SLOTS slots and a key may live in
+// one of two buckets picked from its mixed hash. Each bucket has a version word:
+//
+//     writers lock the key's two buckets through the version (lowest address first) and
+//     bump it when done, so writers to different buckets never wait on each other
+//     readers take no lock, they copy the value out and retry if either version moved
+//     or a writer held one of the buckets. A read fence sits between each version load
+//     and the bucket scan it guards (free on x86, a hardware barrier elsewhere).
+//
+// When both buckets of a new key are full, a key in them is moved to its other bucket if
+// that one has room (and is not locked), and only when none can move does the table double.
+// A key only ever moves between its own two buckets, so readers still see every change. The resize freezes every
+// old bucket (waiting out writers that hold one), copies them into the new array and
+// publishes it. Readers keep reading frozen buckets while that happens, writers wait for
+// the new array.
+// NOTE: Old bucket arrays are retired rather than freed, a reader may still be walking
+// one. They are freed by FUNC##reclaim, which must only be called when no other thread
+// is inside the table (e.g. at a barrier between phases), and by FUNC##destroy. The
+// retired arrays add up to less than the live one.
+//
+// Concurrent hash table type and function declaration, call: CM_CONCURRENT_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE)
+// Concurrent hash table function definitions, call: CM_CONCURRENT_TABLE_DEFINE(NAME, FUNC, VALUE)
+//
+//     PREFIX  - a prefix for function prototypes e.g. extern, static, etc.
+//     NAME    - Name of the Hash Table
+//     FUNC    - the name will prefix function names
+//     VALUE   - the type of the value to be stored, get copies it out
+//
+// NOTE: The allocator is only used by init, reserve, a resize and destroy, under the
+// table's resize lock.
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CM_CONCURRENT_TABLE_BUCKET_SLOTS
+#define CM_CONCURRENT_TABLE_BUCKET_SLOTS 4
+#endif
+#define CM_CONCURRENT_TABLE_MIN_BUCKETS 16
+
+// NOTE: Version bits, the rest of the version counts writes in steps of 4
+#define CM_CONCURRENT_TABLE_LOCKED 1
+#define CM_CONCURRENT_TABLE_FROZEN 2
+
+#define cm__concurrent_table_alt(hash) (((hash) >> 32) | ((hash) << 32))
+
+// NOTE: Keeps a reader's bucket loads between its two loads of the version, a reader
+// issues it after the first and before the second. x86 never reorders loads with loads and
+// cm_atomic32_load is a call the compiler cannot move them across, so only other CPUs pay
+// for a fence. It has to be a hardware barrier there, cm_lfence only stops the compiler
+// on those targets.
+#if defined(CM_CPU_X86)
+	#define cm__concurrent_table_read_fence()
+#elif defined(CM_COMPILER_MSVC)
+	#define cm__concurrent_table_read_fence() MemoryBarrier()
+#else
+	#define cm__concurrent_table_read_fence() __sync_synchronize()
+#endif
+
+// NOTE: Returns false if the bucket has been frozen by a resize
+CM_DEF b32  cm__concurrent_table_lock    (cmAtomic32 volatile *version);
+CM_DEF b32  cm__concurrent_table_try_lock(cmAtomic32 volatile *version);
+CM_DEF void cm__concurrent_table_unlock  (cmAtomic32 volatile *version);
+CM_DEF void cm__concurrent_table_freeze  (cmAtomic32 volatile *version);
+
+#define CM_CONCURRENT_TABLE(PREFIX, NAME, FUNC, VALUE) \
+	CM_CONCURRENT_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE); \
+	CM_CONCURRENT_TABLE_DEFINE(NAME, FUNC, VALUE);
+
+#define CM_CONCURRENT_TABLE_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+typedef struct CM_JOIN2(NAME,Bucket) { \
+	cmAtomic32 version; \
+	i32        count; \
+	u64        keys  [CM_CONCURRENT_TABLE_BUCKET_SLOTS]; \
+	VALUE      values[CM_CONCURRENT_TABLE_BUCKET_SLOTS]; \
+} CM_JOIN2(NAME,Bucket); \
+\
+typedef struct CM_JOIN2(NAME,Buckets) { \
+	isize mask; \
+	struct CM_JOIN2(NAME,Buckets) *retired_next; \
+	CM_JOIN2(NAME,Bucket) *       buckets; \
+} CM_JOIN2(NAME,Buckets); \
+\
+typedef struct NAME { \
+	cmAllocator  allocator; \
+	cmAtomicPtr  buckets; /* NOTE: CM_JOIN2(NAME,Buckets) * */ \
+	cmAtomic64   count; \
+	cmAtomic32   resize_lock; \
+	CM_JOIN2(NAME,Buckets) *retired; \
+} NAME; \
+\
+PREFIX void  CM_JOIN2(FUNC,init)   (NAME *h, cmAllocator a); \
+PREFIX void  CM_JOIN2(FUNC,destroy)(NAME *h); \
+PREFIX b32   CM_JOIN2(FUNC,get)    (NAME *h, u64 key, VALUE *value); \
+PREFIX void  CM_JOIN2(FUNC,set)    (NAME *h, u64 key, VALUE value); \
+PREFIX b32   CM_JOIN2(FUNC,remove) (NAME *h, u64 key); \
+PREFIX isize CM_JOIN2(FUNC,count)  (NAME *h); \
+PREFIX void  CM_JOIN2(FUNC,reserve)(NAME *h, isize count); \
+PREFIX void  CM_JOIN2(FUNC,reclaim)(NAME *h); \
+
+#define CM_CONCURRENT_TABLE_DEFINE(NAME, FUNC, VALUE) \
+cm_internal CM_JOIN2(NAME,Buckets) *CM_JOIN2(FUNC,_alloc_buckets)(cmAllocator a, isize count) { \
+	isize header = (cm_size_of(CM_JOIN2(NAME,Buckets)) + CM_CACHE_LINE_SIZE - 1) & ~(CM_CACHE_LINE_SIZE - 1); \
+	CM_JOIN2(NAME,Buckets) *b = cast(CM_JOIN2(NAME,Buckets) *)cm_alloc_align(a, header + count*cm_size_of(CM_JOIN2(NAME,Bucket)), CM_CACHE_LINE_SIZE); \
+	b->mask         = count - 1; \
+	b->retired_next = NULL; \
+	b->buckets      = cast(CM_JOIN2(NAME,Bucket) *)(cast(u8 *)b + header); \
+	cm_zero_array(b->buckets, count); \
+	return b; \
+} \
+\
+/* NOTE: Puts a new key in the emptier of its buckets, the caller owns both of them */ \
+cm_internal b32 CM_JOIN2(FUNC,_place)(CM_JOIN2(NAME,Buckets) *b, u64 key, u64 hash, VALUE value) { \
+	CM_JOIN2(NAME,Bucket) *b1 = &b->buckets[hash & b->mask]; \
+	CM_JOIN2(NAME,Bucket) *b2 = &b->buckets[cm__concurrent_table_alt(hash) & b->mask]; \
+	CM_JOIN2(NAME,Bucket) *t  = b1->count <= b2->count ? b1 : b2; \
+	if (t->count == CM_CONCURRENT_TABLE_BUCKET_SLOTS) \
+		return false; \
+	t->keys[t->count]   = key; \
+	t->values[t->count] = value; \
+	t->count++; \
+	return true; \
+} \
+\
+/* NOTE: Makes room in lo or hi (both full and held by the caller) by moving one of their */ \
+/* keys to its other bucket */ \
+cm_internal b32 CM_JOIN2(FUNC,_displace)(CM_JOIN2(NAME,Buckets) *b, CM_JOIN2(NAME,Bucket) *lo, CM_JOIN2(NAME,Bucket) *hi) { \
+	isize i, k; \
+	for (k = 0; k < 2; k++) { \
+		CM_JOIN2(NAME,Bucket) *from = k == 0 ? lo : hi; \
+		for (i = 0; i < from->count; i++) { \
+			u64 hash = from->keys[i]; \
+			CM_JOIN2(NAME,Bucket) *to; \
+			CM_HASH_MIX64(hash); \
+			to = &b->buckets[hash & b->mask]; \
+			if (to == from) \
+				to = &b->buckets[cm__concurrent_table_alt(hash) & b->mask]; \
+			if (to == lo || to == hi || to->count == CM_CONCURRENT_TABLE_BUCKET_SLOTS) \
+				continue; \
+			/* NOTE: Only try, waiting here could deadlock with a writer that holds `to` */ \
+			if (!cm__concurrent_table_try_lock(&to->version)) \
+				continue; \
+			if (to->count < CM_CONCURRENT_TABLE_BUCKET_SLOTS) { \
+				to->keys[to->count]   = from->keys[i]; \
+				to->values[to->count] = from->values[i]; \
+				to->count++; \
+				from->count--; \
+				from->keys[i]   = from->keys[from->count]; \
+				from->values[i] = from->values[from->count]; \
+				cm__concurrent_table_unlock(&to->version); \
+				return true; \
+			} \
+			cm__concurrent_table_unlock(&to->version); \
+		} \
+	} \
+	return false; \
+} \
+\
+cm_internal void CM_JOIN2(FUNC,_resize)(NAME *h, CM_JOIN2(NAME,Buckets) *old, isize bucket_count) { \
+	isize i, j; \
+	CM_JOIN2(NAME,Buckets) *nb; \
+	cm_atomic32_spin_lock(&h->resize_lock, -1); \
+	if (cm_atomic_ptr_load(&h->buckets) != old || bucket_count <= old->mask + 1) { \
+		cm_atomic32_spin_unlock(&h->resize_lock); \
+		return; \
+	} \
+	for (i = 0; i <= old->mask; i++) \
+		cm__concurrent_table_freeze(&old->buckets[i].version); \
+	for (;;) { \
+		nb = CM_JOIN2(FUNC,_alloc_buckets)(h->allocator, bucket_count); \
+		for (i = 0; i <= old->mask; i++) { \
+			CM_JOIN2(NAME,Bucket) *b = &old->buckets[i]; \
+			for (j = 0; j < b->count; j++) { \
+				u64 hash = b->keys[j]; \
+				CM_HASH_MIX64(hash); \
+				if (!CM_JOIN2(FUNC,_place)(nb, b->keys[j], hash, b->values[j])) \
+					goto retry; \
+			} \
+		} \
+		break; \
+	retry: \
+		cm_free(h->allocator, nb); \
+		bucket_count *= 2; \
+	} \
+	cm_atomic_ptr_store(&h->buckets, nb); \
+	cm_mfence(); \
+	old->retired_next = h->retired; \
+	h->retired = old; \
+	cm_atomic32_spin_unlock(&h->resize_lock); \
+} \
+\
+void CM_JOIN2(FUNC,init)(NAME *h, cmAllocator a) { \
+	cm_zero_item(h); \
+	h->allocator = a; \
+	cm_atomic_ptr_store(&h->buckets, CM_JOIN2(FUNC,_alloc_buckets)(a, CM_CONCURRENT_TABLE_MIN_BUCKETS)); \
+} \
+\
+void CM_JOIN2(FUNC,destroy)(NAME *h) { \
+	CM_JOIN2(FUNC,reclaim)(h); \
+	cm_free(h->allocator, cm_atomic_ptr_load(&h->buckets)); \
+} \
+\
+void CM_JOIN2(FUNC,reclaim)(NAME *h) { \
+	CM_JOIN2(NAME,Buckets) *b, *next; \
+	cm_atomic32_spin_lock(&h->resize_lock, -1); \
+	for (b = h->retired; b; b = next) { \
+		next = b->retired_next; \
+		cm_free(h->allocator, b); \
+	} \
+	h->retired = NULL; \
+	cm_atomic32_spin_unlock(&h->resize_lock); \
+} \
+\
+/* NOTE: Scans one bucket of a reader's snapshot, the copy is only good if the version holds */ \
+cm_internal b32 CM_JOIN2(FUNC,_scan)(CM_JOIN2(NAME,Bucket) *b, u64 key, VALUE *value) { \
+	isize i, n = CM_MIN(b->count, CM_CONCURRENT_TABLE_BUCKET_SLOTS); \
+	for (i = 0; i < n; i++) { \
+		if (b->keys[i] == key) { \
+			*value = b->values[i]; \
+			return true; \
+		} \
+	} \
+	return false; \
+} \
+\
+b32 CM_JOIN2(FUNC,get)(NAME *h, u64 key, VALUE *value) { \
+	u64 hash = key; \
+	CM_HASH_MIX64(hash); \
+	for (;;) { \
+		CM_JOIN2(NAME,Buckets) *b = cast(CM_JOIN2(NAME,Buckets) *)cm_atomic_ptr_load(&h->buckets); \
+		CM_JOIN2(NAME,Bucket) *b1 = &b->buckets[hash & b->mask]; \
+		CM_JOIN2(NAME,Bucket) *b2 = &b->buckets[cm__concurrent_table_alt(hash) & b->mask]; \
+		i32 v1 = cm_atomic32_load(&b1->version), v2; \
+		b32 found; \
+		VALUE v; \
+		if (v1 & CM_CONCURRENT_TABLE_LOCKED) { \
+			cm_yield_thread(); \
+			continue; \
+		} \
+		cm__concurrent_table_read_fence(); \
+		found = CM_JOIN2(FUNC,_scan)(b1, key, &v); \
+		if (found) { \
+			cm__concurrent_table_read_fence(); \
+			if (cm_atomic32_load(&b1->version) != v1) \
+				continue; \
+			*value = v; \
+			return true; \
+		} \
+		/* NOTE: Missing from b1 only counts if b1 is still unchanged after b2 was read */ \
+		v2 = cm_atomic32_load(&b2->version); \
+		if (v2 & CM_CONCURRENT_TABLE_LOCKED) { \
+			cm_yield_thread(); \
+			continue; \
+		} \
+		cm__concurrent_table_read_fence(); \
+		found = CM_JOIN2(FUNC,_scan)(b2, key, &v); \
+		cm__concurrent_table_read_fence(); \
+		if (cm_atomic32_load(&b1->version) == v1 && cm_atomic32_load(&b2->version) == v2) { \
+			if (found) \
+				*value = v; \
+			return found; \
+		} \
+	} \
+} \
+\
+void CM_JOIN2(FUNC,set)(NAME *h, u64 key, VALUE value) { \
+	u64 hash = key; \
+	CM_HASH_MIX64(hash); \
+	for (;;) { \
+		CM_JOIN2(NAME,Buckets) *b = cast(CM_JOIN2(NAME,Buckets) *)cm_atomic_ptr_load(&h->buckets); \
+		isize i1 = hash & b->mask, i2 = cm__concurrent_table_alt(hash) & b->mask, i; \
+		CM_JOIN2(NAME,Bucket) *lo = &b->buckets[CM_MIN(i1, i2)]; \
+		CM_JOIN2(NAME,Bucket) *hi = &b->buckets[CM_MAX(i1, i2)]; \
+		b32 placed; \
+		if (!cm__concurrent_table_lock(&lo->version)) { \
+			while (cm_atomic_ptr_load(&h->buckets) == b) \
+				cm_yield_thread(); \
+			continue; \
+		} \
+		/* NOTE: A resize freezes lo before hi, so holding lo means hi cannot be frozen */ \
+		if (hi != lo) \
+			cm__concurrent_table_lock(&hi->version); \
+		for (i = 0; i < lo->count; i++) { \
+			if (lo->keys[i] == key) { \
+				lo->values[i] = value; \
+				goto done; \
+			} \
+		} \
+		for (i = 0; hi != lo && i < hi->count; i++) { \
+			if (hi->keys[i] == key) { \
+				hi->values[i] = value; \
+				goto done; \
+			} \
+		} \
+		placed = CM_JOIN2(FUNC,_place)(b, key, hash, value); \
+		if (!placed && CM_JOIN2(FUNC,_displace)(b, lo, hi)) \
+			placed = CM_JOIN2(FUNC,_place)(b, key, hash, value); \
+		if (hi != lo) \
+			cm__concurrent_table_unlock(&hi->version); \
+		cm__concurrent_table_unlock(&lo->version); \
+		if (placed) { \
+			cm_atomic64_fetch_add(&h->count, 1); \
+			return; \
+		} \
+		CM_JOIN2(FUNC,_resize)(h, b, 2*(b->mask + 1)); \
+		continue; \
+	done: \
+		if (hi != lo) \
+			cm__concurrent_table_unlock(&hi->version); \
+		cm__concurrent_table_unlock(&lo->version); \
+		return; \
+	} \
+} \
+\
+b32 CM_JOIN2(FUNC,remove)(NAME *h, u64 key) { \
+	u64 hash = key; \
+	CM_HASH_MIX64(hash); \
+	for (;;) { \
+		CM_JOIN2(NAME,Buckets) *b = cast(CM_JOIN2(NAME,Buckets) *)cm_atomic_ptr_load(&h->buckets); \
+		isize i1 = hash & b->mask, i2 = cm__concurrent_table_alt(hash) & b->mask, i, k; \
+		CM_JOIN2(NAME,Bucket) *lo = &b->buckets[CM_MIN(i1, i2)]; \
+		CM_JOIN2(NAME,Bucket) *hi = &b->buckets[CM_MAX(i1, i2)]; \
+		b32 removed = false; \
+		if (!cm__concurrent_table_lock(&lo->version)) { \
+			while (cm_atomic_ptr_load(&h->buckets) == b) \
+				cm_yield_thread(); \
+			continue; \
+		} \
+		if (hi != lo) \
+			cm__concurrent_table_lock(&hi->version); \
+		for (k = 0; k < 2 && !removed; k++) { \
+			CM_JOIN2(NAME,Bucket) *t = k == 0 ? lo : hi; \
+			for (i = 0; i < t->count; i++) { \
+				if (t->keys[i] == key) { \
+					/* NOTE: Keep the bucket packed by moving its last slot into the hole */ \
+					t->count--; \
+					t->keys[i]   = t->keys[t->count]; \
+					t->values[i] = t->values[t->count]; \
+					removed = true; \
+					break; \
+				} \
+			} \
+		} \
+		if (hi != lo) \
+			cm__concurrent_table_unlock(&hi->version); \
+		cm__concurrent_table_unlock(&lo->version); \
+		if (removed) \
+			cm_atomic64_fetch_add(&h->count, -1); \
+		return removed; \
+	} \
+} \
+\
+isize CM_JOIN2(FUNC,count)(NAME *h) { \
+	return cast(isize)cm_atomic64_load(&h->count); \
+} \
+\
+void CM_JOIN2(FUNC,reserve)(NAME *h, isize count) { \
+	/* NOTE: Sized for buckets 3/4 full on average */ \
+	isize bucket_count = CM_CONCURRENT_TABLE_MIN_BUCKETS; \
+	while (bucket_count*CM_CONCURRENT_TABLE_BUCKET_SLOTS*3/4 < count) \
+		bucket_count *= 2; \
+	CM_JOIN2(FUNC,_resize)(h, cast(CM_JOIN2(NAME,Buckets) *)cm_atomic_ptr_load(&h->buckets), bucket_count); \
+} \
 
 CM_END_EXTERN
 
@@ -19,8 +19,45 @@
 #include "header.h"
 #include "char.h"
 #include "print.h"
+#include "atomics.h"
+#include "fences.h"
+#include "sortsearch.h"
 
+#if defined(CM_HEAP_USE_SYSTEM_MALLOC) && defined(CM_SYS_LINUX)
+#include <malloc.h> // NOTE: malloc_usable_size
+#endif
+
+#if defined(CM_TRACK_CALL_SITES)
+#undef cm_alloc_align
+#undef cm_alloc
+#undef cm_resize_align
+#undef cm_resize
+#endif
+
+
+
+// NOTE: Index of the highest/lowest set bit, x must not be 0
+cm_internal isize
+cm__bit_msb(u64 x) {
+#if defined(CM_COMPILER_MSVC)
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return cast(isize)index;
+#else
+	return 63 - __builtin_clzll(x);
+#endif
+}
 
+cm_internal isize
+cm__bit_lsb(u64 x) {
+#if defined(CM_COMPILER_MSVC)
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return cast(isize)index;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
 
 b32 
 cm_is_power_of_two(isize x) {
@@ -73,11 +110,702 @@ cm_zero_size(void *ptr, isize size) {
 #pragma intrinsic(__movsb)
 #endif
 
+/////////////////////////////////////////////////////////////////
+//
+// SIMD memory primitives
+//
+// NOTE: On x86 with SSE2 as the baseline (always true on x86-64) copies, sets, compares
+// and scans go through SSE2, AVX2 or AVX-512BW versions picked at runtime with cpuid.
+// Inputs of up to 64 bytes are handled inline without the indirect call. Define
+// CM_MEMORY_NO_SIMD to use the scalar versions everywhere.
+//
+
+#if defined(CM_CPU_X86) && !defined(CM_MEMORY_NO_SIMD) && \
+    (defined(CM_ARCH_64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CM__MEMORY_SIMD 1
+#endif
+
+#if defined(CM__MEMORY_SIMD)
+
+#if defined(CM_COMPILER_MSVC)
+	#define CM__TARGET(features)
+	#define CM__NO_SANITIZE_ADDRESS
+	// NOTE: Unaligned scalar access is defined on x86 with MSVC
+	#define CM__MOVE_UNALIGNED(dest, source, size) \
+		((size) == 8 ? cast(void)(*cast(u64 *)(dest) = *cast(u64 const *)(source)) \
+		             : cast(void)(*cast(u32 *)(dest) = *cast(u32 const *)(source)))
+#else
+	#include <immintrin.h>
+	#include <cpuid.h>
+	#define CM__TARGET(features) __attribute__((target(features)))
+	#define CM__NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+	// NOTE: A single mov, without the undefined misaligned pointer access
+	#define CM__MOVE_UNALIGNED(dest, source, size) cast(void)__builtin_memcpy((dest), (source), (size))
+#endif
+
+#define CM__CPU_SSE2      CM_BIT(0)
+#define CM__CPU_AVX2      CM_BIT(1)
+#define CM__CPU_AVX512BW  CM_BIT(2)
+#define CM__CPU_ERMS      CM_BIT(3) // NOTE: Enhanced rep movsb
+#define CM__CPU_DETECTED  CM_BIT(30)
+
+// NOTE: Copies this large are left to rep movsb when the CPU has ERMS
+#ifndef CM_MEMCOPY_REP_THRESHOLD
+#define CM_MEMCOPY_REP_THRESHOLD 2048
+#endif
+
+cm_global u32 volatile cm__cpu_features_value;
+
+cm_internal void
+cm__cpuid(u32 leaf, u32 subleaf, u32 regs[4]) {
+#if defined(CM_COMPILER_MSVC)
+	__cpuidex(cast(int *)regs, cast(int)leaf, cast(int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+cm_internal u64
+cm__xgetbv(u32 index) {
+#if defined(CM_COMPILER_MSVC)
+	return _xgetbv(index);
+#else
+	u32 eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return (cast(u64)edx << 32) | eax;
+#endif
+}
+
+cm_internal u32
+cm__cpu_features(void) {
+	u32 features = cm__cpu_features_value;
+	if (features == 0) {
+		u32 regs[4], max_leaf;
+		u64 xcr0 = 0;
+
+		features = CM__CPU_DETECTED;
+		cm__cpuid(0, 0, regs);
+		max_leaf = regs[0];
+
+		cm__cpuid(1, 0, regs);
+		if (regs[3] & CM_BIT(26))
+			features |= CM__CPU_SSE2;
+		// NOTE: The OS has to save the wider registers too (OSXSAVE, then XCR0)
+		if (regs[2] & CM_BIT(27))
+			xcr0 = cm__xgetbv(0);
+
+		if (max_leaf >= 7) {
+			cm__cpuid(7, 0, regs);
+			if ((regs[1] & CM_BIT(5)) && (xcr0 & 0x06) == 0x06)
+				features |= CM__CPU_AVX2;
+			if ((regs[1] & CM_BIT(16)) && (regs[1] & CM_BIT(30)) && (xcr0 & 0xe6) == 0xe6)
+				features |= CM__CPU_AVX512BW;
+			if (regs[1] & CM_BIT(9))
+				features |= CM__CPU_ERMS;
+		}
+		cm__cpu_features_value = features;
+	}
+	return features;
+}
+
+cm_internal void
+cm__memcopy_rep(void *dest, void const *source, isize n) {
+#if defined(CM_COMPILER_MSVC)
+	__movsb(cast(u8 *)dest, cast(u8 const *)source, n);
+#else
+	__asm__ __volatile__("rep movsb" : "+D"(dest), "+S"(source), "+c"(n) : : "memory");
+#endif
+}
+
+
+//
+// SSE2
+//
+
+// NOTE: All of the copy/set versions are only called for n > 64
+
+cm_internal CM__TARGET("sse2") void *
+cm__memcopy_sse2(void *dest, void const *source, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	u8 const *s = cast(u8 const *)source, *se = s + n;
+	isize k;
+
+	if (n >= CM_MEMCOPY_REP_THRESHOLD && (cm__cpu_features() & CM__CPU_ERMS)) {
+		cm__memcopy_rep(dest, source, n);
+		return dest;
+	}
+
+	_mm_storeu_si128(cast(__m128i *)d, _mm_loadu_si128(cast(__m128i const *)s));
+	k = 16 - (cast(uintptr)d & 15);
+	d += k, s += k, n -= k;
+	for (; n > 64; d += 64, s += 64, n -= 64) {
+		__m128i a = _mm_loadu_si128(cast(__m128i const *)(s +  0));
+		__m128i b = _mm_loadu_si128(cast(__m128i const *)(s + 16));
+		__m128i c = _mm_loadu_si128(cast(__m128i const *)(s + 32));
+		__m128i e = _mm_loadu_si128(cast(__m128i const *)(s + 48));
+		_mm_store_si128(cast(__m128i *)(d +  0), a);
+		_mm_store_si128(cast(__m128i *)(d + 16), b);
+		_mm_store_si128(cast(__m128i *)(d + 32), c);
+		_mm_store_si128(cast(__m128i *)(d + 48), e);
+	}
+	_mm_storeu_si128(cast(__m128i *)(de - 64), _mm_loadu_si128(cast(__m128i const *)(se - 64)));
+	_mm_storeu_si128(cast(__m128i *)(de - 48), _mm_loadu_si128(cast(__m128i const *)(se - 48)));
+	_mm_storeu_si128(cast(__m128i *)(de - 32), _mm_loadu_si128(cast(__m128i const *)(se - 32)));
+	_mm_storeu_si128(cast(__m128i *)(de - 16), _mm_loadu_si128(cast(__m128i const *)(se - 16)));
+	return dest;
+}
+
+cm_internal CM__TARGET("sse2") void *
+cm__memset_sse2(void *dest, u8 c, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	__m128i v = _mm_set1_epi8(cast(char)c);
+	isize k;
+
+	_mm_storeu_si128(cast(__m128i *)d, v);
+	k = 16 - (cast(uintptr)d & 15);
+	d += k, n -= k;
+	for (; n > 64; d += 64, n -= 64) {
+		_mm_store_si128(cast(__m128i *)(d +  0), v);
+		_mm_store_si128(cast(__m128i *)(d + 16), v);
+		_mm_store_si128(cast(__m128i *)(d + 32), v);
+		_mm_store_si128(cast(__m128i *)(d + 48), v);
+	}
+	_mm_storeu_si128(cast(__m128i *)(de - 64), v);
+	_mm_storeu_si128(cast(__m128i *)(de - 48), v);
+	_mm_storeu_si128(cast(__m128i *)(de - 32), v);
+	_mm_storeu_si128(cast(__m128i *)(de - 16), v);
+	return dest;
+}
+
+// NOTE: n >= 16, the last block overlaps blocks already known to be equal
+cm_internal CM__TARGET("sse2") i32
+cm__memcompare_sse2(void const *s1, void const *s2, isize n) {
+	u8 const *a = cast(u8 const *)s1;
+	u8 const *b = cast(u8 const *)s2;
+	isize i = 0;
+	u32 mask;
+
+	for (;;) {
+		if (i + 16 > n)
+			i = n - 16;
+		mask = cast(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(cast(__m128i const *)(a + i)),
+		                                                 _mm_loadu_si128(cast(__m128i const *)(b + i)))) ^ 0xffff;
+		if (mask) {
+			i += cm__bit_lsb(mask);
+			return cast(i32)a[i] - cast(i32)b[i];
+		}
+		i += 16;
+		if (i >= n)
+			return 0;
+	}
+}
+
+// NOTE: Aligned loads never cross a page, so scanning past the first match (or past
+// the end of a string handed to cm_strnlen with a large bound) cannot fault
+cm_internal CM__TARGET("sse2") CM__NO_SANITIZE_ADDRESS void const *
+cm__memchr_sse2(void const *data, u8 c, isize n) {
+	u8 const *s = cast(u8 const *)data;
+	u8 const *p = cast(u8 const *)(cast(uintptr)s & ~cast(uintptr)15);
+	__m128i v = _mm_set1_epi8(cast(char)c);
+	u32 mask = cast(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(cast(__m128i const *)p), v)) >> (s - p);
+	isize i;
+
+	if (mask) {
+		i = cm__bit_lsb(mask);
+		return i < n ? s + i : NULL;
+	}
+	for (p += 16; p - s < n; p += 16) {
+		mask = cast(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(cast(__m128i const *)p), v));
+		if (mask) {
+			i = (p - s) + cm__bit_lsb(mask);
+			return i < n ? s + i : NULL;
+		}
+	}
+	return NULL;
+}
+
+// NOTE: n >= 16
+cm_internal CM__TARGET("sse2") void const *
+cm__memrchr_sse2(void const *data, u8 c, isize n) {
+	u8 const *s = cast(u8 const *)data;
+	__m128i v = _mm_set1_epi8(cast(char)c);
+	u32 mask;
+
+	for (; n >= 16; n -= 16) {
+		mask = cast(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(cast(__m128i const *)(s + n - 16)), v));
+		if (mask)
+			return s + n - 16 + cm__bit_msb(mask);
+	}
+	if (n > 0) {
+		mask = cast(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(cast(__m128i const *)s), v)) & ((1u << n) - 1);
+		if (mask)
+			return s + cm__bit_msb(mask);
+	}
+	return NULL;
+}
+
+
+//
+// AVX2
+//
+
+cm_internal CM__TARGET("avx2") void *
+cm__memcopy_avx2(void *dest, void const *source, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	u8 const *s = cast(u8 const *)source, *se = s + n;
+	isize k;
+
+	if (n <= 128) {
+		__m256i a = _mm256_loadu_si256(cast(__m256i const *)(s +  0));
+		__m256i b = _mm256_loadu_si256(cast(__m256i const *)(s + 32));
+		__m256i c = _mm256_loadu_si256(cast(__m256i const *)(se - 64));
+		__m256i e = _mm256_loadu_si256(cast(__m256i const *)(se - 32));
+		_mm256_storeu_si256(cast(__m256i *)(d +  0), a);
+		_mm256_storeu_si256(cast(__m256i *)(d + 32), b);
+		_mm256_storeu_si256(cast(__m256i *)(de - 64), c);
+		_mm256_storeu_si256(cast(__m256i *)(de - 32), e);
+		return dest;
+	}
+	if (n >= CM_MEMCOPY_REP_THRESHOLD && (cm__cpu_features() & CM__CPU_ERMS)) {
+		cm__memcopy_rep(dest, source, n);
+		return dest;
+	}
+
+	_mm256_storeu_si256(cast(__m256i *)d, _mm256_loadu_si256(cast(__m256i const *)s));
+	k = 32 - (cast(uintptr)d & 31);
+	d += k, s += k, n -= k;
+	for (; n > 128; d += 128, s += 128, n -= 128) {
+		__m256i a = _mm256_loadu_si256(cast(__m256i const *)(s +  0));
+		__m256i b = _mm256_loadu_si256(cast(__m256i const *)(s + 32));
+		__m256i c = _mm256_loadu_si256(cast(__m256i const *)(s + 64));
+		__m256i e = _mm256_loadu_si256(cast(__m256i const *)(s + 96));
+		_mm256_store_si256(cast(__m256i *)(d +  0), a);
+		_mm256_store_si256(cast(__m256i *)(d + 32), b);
+		_mm256_store_si256(cast(__m256i *)(d + 64), c);
+		_mm256_store_si256(cast(__m256i *)(d + 96), e);
+	}
+	_mm256_storeu_si256(cast(__m256i *)(de - 128), _mm256_loadu_si256(cast(__m256i const *)(se - 128)));
+	_mm256_storeu_si256(cast(__m256i *)(de -  96), _mm256_loadu_si256(cast(__m256i const *)(se -  96)));
+	_mm256_storeu_si256(cast(__m256i *)(de -  64), _mm256_loadu_si256(cast(__m256i const *)(se -  64)));
+	_mm256_storeu_si256(cast(__m256i *)(de -  32), _mm256_loadu_si256(cast(__m256i const *)(se -  32)));
+	return dest;
+}
+
+cm_internal CM__TARGET("avx2") void *
+cm__memset_avx2(void *dest, u8 c, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	__m256i v = _mm256_set1_epi8(cast(char)c);
+	isize k;
+
+	if (n <= 128) {
+		_mm256_storeu_si256(cast(__m256i *)(d +  0), v);
+		_mm256_storeu_si256(cast(__m256i *)(d + 32), v);
+		_mm256_storeu_si256(cast(__m256i *)(de - 64), v);
+		_mm256_storeu_si256(cast(__m256i *)(de - 32), v);
+		return dest;
+	}
+
+	_mm256_storeu_si256(cast(__m256i *)d, v);
+	k = 32 - (cast(uintptr)d & 31);
+	d += k, n -= k;
+	for (; n > 128; d += 128, n -= 128) {
+		_mm256_store_si256(cast(__m256i *)(d +  0), v);
+		_mm256_store_si256(cast(__m256i *)(d + 32), v);
+		_mm256_store_si256(cast(__m256i *)(d + 64), v);
+		_mm256_store_si256(cast(__m256i *)(d + 96), v);
+	}
+	_mm256_storeu_si256(cast(__m256i *)(de - 128), v);
+	_mm256_storeu_si256(cast(__m256i *)(de -  96), v);
+	_mm256_storeu_si256(cast(__m256i *)(de -  64), v);
+	_mm256_storeu_si256(cast(__m256i *)(de -  32), v);
+	return dest;
+}
+
+cm_internal CM__TARGET("avx2") i32
+cm__memcompare_avx2(void const *s1, void const *s2, isize n) {
+	u8 const *a = cast(u8 const *)s1;
+	u8 const *b = cast(u8 const *)s2;
+	isize i = 0;
+	u32 mask;
+
+	if (n < 32)
+		return cm__memcompare_sse2(s1, s2, n);
+
+	for (;;) {
+		if (i + 32 > n)
+			i = n - 32;
+		mask = ~cast(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(cast(__m256i const *)(a + i)),
+		                                                        _mm256_loadu_si256(cast(__m256i const *)(b + i))));
+		if (mask) {
+			i += cm__bit_lsb(mask);
+			return cast(i32)a[i] - cast(i32)b[i];
+		}
+		i += 32;
+		if (i >= n)
+			return 0;
+	}
+}
+
+cm_internal CM__TARGET("avx2") CM__NO_SANITIZE_ADDRESS void const *
+cm__memchr_avx2(void const *data, u8 c, isize n) {
+	u8 const *s = cast(u8 const *)data;
+	u8 const *p = cast(u8 const *)(cast(uintptr)s & ~cast(uintptr)31);
+	__m256i v = _mm256_set1_epi8(cast(char)c);
+	u32 mask = cast(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(cast(__m256i const *)p), v)) >> (s - p);
+	isize i;
+
+	if (mask) {
+		i = cm__bit_lsb(mask);
+		return i < n ? s + i : NULL;
+	}
+	for (p += 32; p - s < n; p += 32) {
+		mask = cast(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(cast(__m256i const *)p), v));
+		if (mask) {
+			i = (p - s) + cm__bit_lsb(mask);
+			return i < n ? s + i : NULL;
+		}
+	}
+	return NULL;
+}
+
+cm_internal CM__TARGET("avx2") void const *
+cm__memrchr_avx2(void const *data, u8 c, isize n) {
+	u8 const *s = cast(u8 const *)data;
+	__m256i v = _mm256_set1_epi8(cast(char)c);
+	u32 mask;
+
+	if (n < 32)
+		return cm__memrchr_sse2(data, c, n);
+
+	for (; n >= 32; n -= 32) {
+		mask = cast(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(cast(__m256i const *)(s + n - 32)), v));
+		if (mask)
+			return s + n - 32 + cm__bit_msb(mask);
+	}
+	if (n > 0) {
+		mask = cast(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(cast(__m256i const *)s), v)) & ((1u << n) - 1);
+		if (mask)
+			return s + cm__bit_msb(mask);
+	}
+	return NULL;
+}
+
+
+//
+// AVX-512BW
+//
+
+cm_internal CM__TARGET("avx512f,avx512bw") void *
+cm__memcopy_avx512(void *dest, void const *source, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	u8 const *s = cast(u8 const *)source, *se = s + n;
+	isize k;
+
+	if (n <= 128) {
+		__m512i a = _mm512_loadu_si512(s);
+		__m512i b = _mm512_loadu_si512(se - 64);
+		_mm512_storeu_si512(d, a);
+		_mm512_storeu_si512(de - 64, b);
+		return dest;
+	}
+	if (n >= CM_MEMCOPY_REP_THRESHOLD && (cm__cpu_features() & CM__CPU_ERMS)) {
+		cm__memcopy_rep(dest, source, n);
+		return dest;
+	}
+
+	_mm512_storeu_si512(d, _mm512_loadu_si512(s));
+	k = 64 - (cast(uintptr)d & 63);
+	d += k, s += k, n -= k;
+	for (; n > 128; d += 128, s += 128, n -= 128) {
+		__m512i a = _mm512_loadu_si512(s +  0);
+		__m512i b = _mm512_loadu_si512(s + 64);
+		_mm512_store_si512(d +  0, a);
+		_mm512_store_si512(d + 64, b);
+	}
+	_mm512_storeu_si512(de - 128, _mm512_loadu_si512(se - 128));
+	_mm512_storeu_si512(de -  64, _mm512_loadu_si512(se -  64));
+	return dest;
+}
+
+cm_internal CM__TARGET("avx512f,avx512bw") void *
+cm__memset_avx512(void *dest, u8 c, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	__m512i v = _mm512_set1_epi8(cast(char)c);
+	isize k;
+
+	if (n <= 128) {
+		_mm512_storeu_si512(d, v);
+		_mm512_storeu_si512(de - 64, v);
+		return dest;
+	}
+
+	_mm512_storeu_si512(d, v);
+	k = 64 - (cast(uintptr)d & 63);
+	d += k, n -= k;
+	for (; n > 128; d += 128, n -= 128) {
+		_mm512_store_si512(d +  0, v);
+		_mm512_store_si512(d + 64, v);
+	}
+	_mm512_storeu_si512(de - 128, v);
+	_mm512_storeu_si512(de -  64, v);
+	return dest;
+}
+
+cm_internal CM__TARGET("avx512f,avx512bw") i32
+cm__memcompare_avx512(void const *s1, void const *s2, isize n) {
+	u8 const *a = cast(u8 const *)s1;
+	u8 const *b = cast(u8 const *)s2;
+	isize i = 0;
+	u64 mask;
+
+	if (n < 64)
+		return cm__memcompare_avx2(s1, s2, n);
+
+	for (;;) {
+		if (i + 64 > n)
+			i = n - 64;
+		mask = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+		if (mask) {
+			i += cm__bit_lsb(mask);
+			return cast(i32)a[i] - cast(i32)b[i];
+		}
+		i += 64;
+		if (i >= n)
+			return 0;
+	}
+}
+
+cm_internal CM__TARGET("avx512f,avx512bw") CM__NO_SANITIZE_ADDRESS void const *
+cm__memchr_avx512(void const *data, u8 c, isize n) {
+	u8 const *s = cast(u8 const *)data;
+	u8 const *p = cast(u8 const *)(cast(uintptr)s & ~cast(uintptr)63);
+	__m512i v = _mm512_set1_epi8(cast(char)c);
+	u64 mask = _mm512_cmpeq_epi8_mask(_mm512_load_si512(p), v) >> (s - p);
+	isize i;
+
+	if (mask) {
+		i = cm__bit_lsb(mask);
+		return i < n ? s + i : NULL;
+	}
+	for (p += 64; p - s < n; p += 64) {
+		mask = _mm512_cmpeq_epi8_mask(_mm512_load_si512(p), v);
+		if (mask) {
+			i = (p - s) + cm__bit_lsb(mask);
+			return i < n ? s + i : NULL;
+		}
+	}
+	return NULL;
+}
+
+cm_internal CM__TARGET("avx512f,avx512bw") void const *
+cm__memrchr_avx512(void const *data, u8 c, isize n) {
+	u8 const *s = cast(u8 const *)data;
+	__m512i v = _mm512_set1_epi8(cast(char)c);
+	u64 mask;
+
+	if (n < 64)
+		return cm__memrchr_avx2(data, c, n);
+
+	for (; n >= 64; n -= 64) {
+		mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(s + n - 64), v);
+		if (mask)
+			return s + n - 64 + cm__bit_msb(mask);
+	}
+	if (n > 0) {
+		mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(s), v) & ((cast(u64)1 << n) - 1);
+		if (mask)
+			return s + cm__bit_msb(mask);
+	}
+	return NULL;
+}
+
+
+//
+// Dispatch
+//
+
+typedef struct cmMemoryProcs {
+	void *      (*copy)   (void *dest, void const *source, isize n);
+	void *      (*set)    (void *dest, u8 c, isize n);
+	i32         (*compare)(void const *s1, void const *s2, isize n);
+	void const *(*chr)    (void const *data, u8 c, isize n);
+	void const *(*rchr)   (void const *data, u8 c, isize n);
+} cmMemoryProcs;
+
+cm_internal void        *cm__memcopy_init   (void *dest, void const *source, isize n);
+cm_internal void        *cm__memset_init    (void *dest, u8 c, isize n);
+cm_internal i32          cm__memcompare_init(void const *s1, void const *s2, isize n);
+cm_internal void const  *cm__memchr_init    (void const *data, u8 c, isize n);
+cm_internal void const  *cm__memrchr_init   (void const *data, u8 c, isize n);
+
+// NOTE: Starts out pointing at stubs that pick the best versions on first use
+cm_global cmMemoryProcs cm__memory_procs = {
+	cm__memcopy_init, cm__memset_init, cm__memcompare_init, cm__memchr_init, cm__memrchr_init,
+};
+
+cm_internal void
+cm__memory_procs_init(void) {
+	u32 features = cm__cpu_features();
+	cmMemoryProcs procs;
+	if (features & CM__CPU_AVX512BW) {
+		procs.copy    = cm__memcopy_avx512;
+		procs.set     = cm__memset_avx512;
+		procs.compare = cm__memcompare_avx512;
+		procs.chr     = cm__memchr_avx512;
+		procs.rchr    = cm__memrchr_avx512;
+	} else if (features & CM__CPU_AVX2) {
+		procs.copy    = cm__memcopy_avx2;
+		procs.set     = cm__memset_avx2;
+		procs.compare = cm__memcompare_avx2;
+		procs.chr     = cm__memchr_avx2;
+		procs.rchr    = cm__memrchr_avx2;
+	} else {
+		procs.copy    = cm__memcopy_sse2;
+		procs.set     = cm__memset_sse2;
+		procs.compare = cm__memcompare_sse2;
+		procs.chr     = cm__memchr_sse2;
+		procs.rchr    = cm__memrchr_sse2;
+	}
+	// NOTE: Every thread computes the same table, so racing here is harmless
+	cm__memory_procs = procs;
+}
+
+cm_internal void *
+cm__memcopy_init(void *dest, void const *source, isize n) {
+	cm__memory_procs_init();
+	return cm__memory_procs.copy(dest, source, n);
+}
+
+cm_internal void *
+cm__memset_init(void *dest, u8 c, isize n) {
+	cm__memory_procs_init();
+	return cm__memory_procs.set(dest, c, n);
+}
+
+cm_internal i32
+cm__memcompare_init(void const *s1, void const *s2, isize n) {
+	cm__memory_procs_init();
+	return cm__memory_procs.compare(s1, s2, n);
+}
+
+cm_internal void const *
+cm__memchr_init(void const *data, u8 c, isize n) {
+	cm__memory_procs_init();
+	return cm__memory_procs.chr(data, c, n);
+}
+
+cm_internal void const *
+cm__memrchr_init(void const *data, u8 c, isize n) {
+	cm__memory_procs_init();
+	return cm__memory_procs.rchr(data, c, n);
+}
+
+
+
+//
+// Streaming
+//
+
+// NOTE: n > 64. Stores bypass the cache, the caller issues the sfence
+cm_internal CM__TARGET("sse2") void
+cm__memcopy_stream_sse2(void *dest, void const *source, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	u8 const *s = cast(u8 const *)source, *se = s + n;
+	isize k;
+
+	_mm_storeu_si128(cast(__m128i *)d, _mm_loadu_si128(cast(__m128i const *)s));
+	k = 16 - (cast(uintptr)d & 15);
+	d += k, s += k, n -= k;
+	for (; n > 64; d += 64, s += 64, n -= 64) {
+		__m128i a = _mm_loadu_si128(cast(__m128i const *)(s +  0));
+		__m128i b = _mm_loadu_si128(cast(__m128i const *)(s + 16));
+		__m128i c = _mm_loadu_si128(cast(__m128i const *)(s + 32));
+		__m128i e = _mm_loadu_si128(cast(__m128i const *)(s + 48));
+		_mm_stream_si128(cast(__m128i *)(d +  0), a);
+		_mm_stream_si128(cast(__m128i *)(d + 16), b);
+		_mm_stream_si128(cast(__m128i *)(d + 32), c);
+		_mm_stream_si128(cast(__m128i *)(d + 48), e);
+	}
+	_mm_storeu_si128(cast(__m128i *)(de - 64), _mm_loadu_si128(cast(__m128i const *)(se - 64)));
+	_mm_storeu_si128(cast(__m128i *)(de - 48), _mm_loadu_si128(cast(__m128i const *)(se - 48)));
+	_mm_storeu_si128(cast(__m128i *)(de - 32), _mm_loadu_si128(cast(__m128i const *)(se - 32)));
+	_mm_storeu_si128(cast(__m128i *)(de - 16), _mm_loadu_si128(cast(__m128i const *)(se - 16)));
+}
+
+cm_internal CM__TARGET("sse2") void
+cm__memset_stream_sse2(void *dest, u8 c, isize n) {
+	u8 *d = cast(u8 *)dest, *de = d + n;
+	__m128i v = _mm_set1_epi8(cast(char)c);
+	isize k;
+
+	_mm_storeu_si128(cast(__m128i *)d, v);
+	k = 16 - (cast(uintptr)d & 15);
+	d += k, n -= k;
+	for (; n > 64; d += 64, n -= 64) {
+		_mm_stream_si128(cast(__m128i *)(d +  0), v);
+		_mm_stream_si128(cast(__m128i *)(d + 16), v);
+		_mm_stream_si128(cast(__m128i *)(d + 32), v);
+		_mm_stream_si128(cast(__m128i *)(d + 48), v);
+	}
+	_mm_storeu_si128(cast(__m128i *)(de - 64), v);
+	_mm_storeu_si128(cast(__m128i *)(de - 48), v);
+	_mm_storeu_si128(cast(__m128i *)(de - 32), v);
+	_mm_storeu_si128(cast(__m128i *)(de - 16), v);
+}
+
+#endif // CM__MEMORY_SIMD
+
+
 
 cm_inline void *
 cm_memcopy(void *dest, void const *source, isize n) {
 
-#if defined(_MSC_VER)
+#if defined(CM__MEMORY_SIMD)
+	u8 *d = cast(u8 *)dest;
+	u8 const *s = cast(u8 const *)source;
+
+	if (dest == NULL) {
+		return NULL;
+	}
+
+	// NOTE: Small copies move both ends at once, overlapping in the middle
+	if (n <= 16) {
+		if (n >= 8) {
+			u64 a, b;
+			CM__MOVE_UNALIGNED(&a, s, 8);
+			CM__MOVE_UNALIGNED(&b, s+n-8, 8);
+			CM__MOVE_UNALIGNED(d, &a, 8);
+			CM__MOVE_UNALIGNED(d+n-8, &b, 8);
+		} else if (n >= 4) {
+			u32 a, b;
+			CM__MOVE_UNALIGNED(&a, s, 4);
+			CM__MOVE_UNALIGNED(&b, s+n-4, 4);
+			CM__MOVE_UNALIGNED(d, &a, 4);
+			CM__MOVE_UNALIGNED(d+n-4, &b, 4);
+		} else if (n > 0) {
+			u8 a = s[0], b = s[n/2], c = s[n-1];
+			d[0] = a, d[n/2] = b, d[n-1] = c;
+		}
+	} else if (n <= 32) {
+		__m128i a = _mm_loadu_si128(cast(__m128i const *)s);
+		__m128i b = _mm_loadu_si128(cast(__m128i const *)(s+n-16));
+		_mm_storeu_si128(cast(__m128i *)d, a);
+		_mm_storeu_si128(cast(__m128i *)(d+n-16), b);
+	} else if (n <= 64) {
+		__m128i a = _mm_loadu_si128(cast(__m128i const *)s);
+		__m128i b = _mm_loadu_si128(cast(__m128i const *)(s+16));
+		__m128i c = _mm_loadu_si128(cast(__m128i const *)(s+n-32));
+		__m128i e = _mm_loadu_si128(cast(__m128i const *)(s+n-16));
+		_mm_storeu_si128(cast(__m128i *)d, a);
+		_mm_storeu_si128(cast(__m128i *)(d+16), b);
+		_mm_storeu_si128(cast(__m128i *)(d+n-32), c);
+		_mm_storeu_si128(cast(__m128i *)(d+n-16), e);
+	} else if (CM_MEMORY_STREAM_THRESHOLD > 0 && n >= CM_MEMORY_STREAM_THRESHOLD) {
+		cm_memcopy_stream(dest, source, n);
+	} else {
+		cm__memory_procs.copy(dest, source, n);
+	}
+#elif defined(_MSC_VER)
 if (dest == NULL) {
 		return NULL;
 	}
@@ -293,6 +1021,36 @@ void *cm_memset(void *dest, u8 c, isize n) {
 		return NULL;
 	}
 
+#if defined(CM__MEMORY_SIMD)
+	if (n <= 16) {
+		if (n >= 8) {
+			u64 c64 = (cast(u64)c32 << 32) | c32;
+			*cast(u64 *)s = c64;
+			*cast(u64 *)(s+n-8) = c64;
+		} else if (n >= 4) {
+			*cast(u32 *)s = c32;
+			*cast(u32 *)(s+n-4) = c32;
+		} else if (n > 0) {
+			s[0] = s[n/2] = s[n-1] = c;
+		}
+	} else if (n <= 32) {
+		__m128i v = _mm_set1_epi8(cast(char)c);
+		_mm_storeu_si128(cast(__m128i *)s, v);
+		_mm_storeu_si128(cast(__m128i *)(s+n-16), v);
+	} else if (n <= 64) {
+		__m128i v = _mm_set1_epi8(cast(char)c);
+		_mm_storeu_si128(cast(__m128i *)s, v);
+		_mm_storeu_si128(cast(__m128i *)(s+16), v);
+		_mm_storeu_si128(cast(__m128i *)(s+n-32), v);
+		_mm_storeu_si128(cast(__m128i *)(s+n-16), v);
+	} else if (CM_MEMORY_STREAM_THRESHOLD > 0 && n >= CM_MEMORY_STREAM_THRESHOLD) {
+		cm_memset_stream(dest, c, n);
+	} else {
+		cm__memory_procs.set(dest, c, n);
+	}
+	return dest;
+#endif
+
 	if (n == 0)
 		return dest;
 	s[0] = s[n-1] = c;
@@ -353,9 +1111,43 @@ void *cm_memset(void *dest, u8 c, isize n) {
 	return dest;
 }
 
+void *
+cm_memcopy_stream(void *dest, void const *source, isize n) {
+#if defined(CM__MEMORY_SIMD)
+	if (dest == NULL) {
+		return NULL;
+	}
+	if (n <= 64) {
+		return cm_memcopy(dest, source, n);
+	}
+	cm__memcopy_stream_sse2(dest, source, n);
+	cm_sfence();
+	return dest;
+#else
+	// NOTE: No non-temporal stores here, cm_memcopy never switches to this version
+	return cm_memcopy(dest, source, n);
+#endif
+}
+
+void *
+cm_memset_stream(void *dest, u8 c, isize n) {
+#if defined(CM__MEMORY_SIMD)
+	if (dest == NULL) {
+		return NULL;
+	}
+	if (n <= 64) {
+		return cm_memset(dest, c, n);
+	}
+	cm__memset_stream_sse2(dest, c, n);
+	cm_sfence();
+	return dest;
+#else
+	return cm_memset(dest, c, n);
+#endif
+}
+
 cm_inline i32 
 cm_memcompare(void const *s1, void const *s2, isize size) {
-	// TODO(bill): Heavily optimize
 	u8 const *s1p8 = cast(u8 const *)s1;
 	u8 const *s2p8 = cast(u8 const *)s2;
 
@@ -363,6 +1155,28 @@ cm_memcompare(void const *s1, void const *s2, isize size) {
 		return 0;
 	}
 
+#if defined(CM__MEMORY_SIMD)
+	if (size >= 16) {
+		return cm__memory_procs.compare(s1, s2, size);
+	}
+#endif
+
+	// NOTE: Skip equal words, the bytes of the first differing word decide the order. Only when
+	// both pointers reach a word boundary together, so every word load is aligned.
+	if (((cast(uintptr)s1p8 ^ cast(uintptr)s2p8) & (sizeof(usize)-1)) == 0) {
+		while ((cast(uintptr)s1p8 & (sizeof(usize)-1)) && size) {
+			if (*s1p8 != *s2p8) {
+				return (*s1p8 - *s2p8);
+			}
+			s1p8++, s2p8++, size--;
+		}
+		while (size >= cm_size_of(usize) && *cast(usize const *)s1p8 == *cast(usize const *)s2p8) {
+			s1p8 += cm_size_of(usize);
+			s2p8 += cm_size_of(usize);
+			size -= cm_size_of(usize);
+		}
+	}
+
 	while (size--) {
 		if (*s1p8 != *s2p8) {
 			return (*s1p8 - *s2p8);
@@ -413,6 +1227,11 @@ cm_memswap(void *i, void *j, isize size) {
 void const *
 cm_memchr(void const *data, u8 c, isize n) {
 	u8 const *s = cast(u8 const *)data;
+#if defined(CM__MEMORY_SIMD)
+	if (n >= 16) {
+		return cm__memory_procs.chr(data, c, n);
+	}
+#endif
 	while ((cast(uintptr)s & (sizeof(usize)-1)) &&
 	       n && *s != c) {
 		s++;
@@ -439,9 +1258,25 @@ cm_memchr(void const *data, u8 c, isize n) {
 void const *
 cm_memrchr(void const *data, u8 c, isize n) {
 	u8 const *s = cast(u8 const *)data;
-	while (n--) {
-		if (s[n] == c)
-			return cast(void const *)(s + n);
+#if defined(CM__MEMORY_SIMD)
+	if (n >= 16) {
+		return cm__memory_procs.rchr(data, c, n);
+	}
+#else
+	while (n && (cast(uintptr)(s+n) & (sizeof(usize)-1))) {
+		if (s[--n] == c)
+			return cast(void const *)(s + n);
+	}
+	{
+		usize k = CM__ONES * c;
+		while (n >= cm_size_of(usize) && !CM__HAS_ZERO(*cast(usize const *)(s+n-cm_size_of(usize)) ^ k)) {
+			n -= cm_size_of(usize);
+		}
+	}
+#endif
+	while (n--) {
+		if (s[n] == c)
+			return cast(void const *)(s + n);
 	}
 	return NULL;
 }
@@ -476,6 +1311,51 @@ cm_resize_align(cmAllocator a, void *ptr, isize old_size, isize new_size, isize
     return a.proc(a.data, cmAllocation_Resize, new_size, alignment, ptr, old_size, CM_DEFAULT_ALLOCATOR_FLAGS); 
 }
 
+isize
+cm_alloc_batch_align(cmAllocator a, void **ptrs, isize count, isize size, isize alignment) {
+	isize i;
+	if (count <= 0)
+		return 0;
+	cm_zero_size(ptrs, count * cm_size_of(void *));
+	if (a.proc(a.data, cmAllocation_AllocBatch, size, alignment, ptrs, count, CM_DEFAULT_ALLOCATOR_FLAGS))
+		return count;
+	for (i = 0; i < count; i++) {
+		if (ptrs[i] == NULL) {
+			ptrs[i] = a.proc(a.data, cmAllocation_Alloc, size, alignment, NULL, 0, CM_DEFAULT_ALLOCATOR_FLAGS);
+			if (ptrs[i] == NULL)
+				break;
+		}
+	}
+	return i;
+}
+
+cm_inline isize
+cm_alloc_batch(cmAllocator a, void **ptrs, isize count, isize size) {
+	return cm_alloc_batch_align(a, ptrs, count, size, CM_DEFAULT_MEMORY_ALIGNMENT);
+}
+
+void
+cm_free_batch(cmAllocator a, void **ptrs, isize count) {
+	isize i;
+	if (count <= 0)
+		return;
+	if (a.proc(a.data, cmAllocation_FreeBatch, 0, 0, ptrs, count, CM_DEFAULT_ALLOCATOR_FLAGS))
+		return;
+	for (i = 0; i < count; i++)
+		cm_free(a, ptrs[i]);
+}
+
+isize
+cm_usable_size(cmAllocator a, void *ptr, isize size) {
+	void *end;
+	if (ptr == NULL)
+		return 0;
+	end = a.proc(a.data, cmAllocation_UsableSize, size, 0, ptr, 0, 0);
+	if (end == NULL)
+		return size;
+	return CM_MAX(size, cm_pointer_diff(ptr, end));
+}
+
 cm_inline void *
 cm_alloc_copy(cmAllocator a, void const *src, isize size) {
 	return cm_memcopy(cm_alloc(a, size), src, size);
@@ -532,6 +1412,9 @@ cm_heap_allocator(void) {
 }
 
 CM_ALLOCATOR_PROC(cm_heap_allocator_proc) {
+#if !defined(CM_HEAP_USE_SYSTEM_MALLOC)
+	return cm_tc_heap_allocator_proc(allocator_data, type, size, alignment, old_memory, old_size, flags);
+#else
 	void *ptr = NULL;
 	cm_unused(allocator_data);
 	cm_unused(old_size);
@@ -569,12 +1452,16 @@ CM_ALLOCATOR_PROC(cm_heap_allocator_proc) {
 		// ptr = realloc(old_memory, size);
 		ptr = cm_default_resize_align(cm_heap_allocator(), old_memory, old_size, size, alignment);
 	} break;
+
+	case cmAllocation_UsableSize:
+		ptr = cast(u8 *)old_memory + malloc_usable_size(old_memory);
+		break;
 #else
 	// TODO(bill): *nix version that's decent
 	case cmAllocation_Alloc: {
 		posix_memalign(&ptr, alignment, size);
 
-		if (flags & gbAllocatorFlag_ClearToZero) {
+		if (flags & cmAllocatorFlag_ClearToZero) {
 			cm_zero_size(ptr, size);
 		}
 	} break;
@@ -590,9 +1477,13 @@ CM_ALLOCATOR_PROC(cm_heap_allocator_proc) {
 
 	case cmAllocation_FreeAll:
 		break;
+
+	default:
+		break;
 	}
 
 	return ptr;
+#endif
 }
 
 
@@ -621,21 +1512,44 @@ cm_vm_alloc(void *addr, isize size) {
 	return vm;
 }
 
+cm_inline cmVirtualMemory 
+cm_vm_reserve(void *addr, isize size) {
+	cmVirtualMemory vm;
+	CM_ASSERT(size > 0);
+	vm.data = VirtualAlloc(addr, size, MEM_RESERVE, PAGE_NOACCESS);
+	vm.size = size;
+	return vm;
+}
+
+cm_inline b32 
+cm_vm_commit(cmVirtualMemory vm) {
+	return VirtualAlloc(vm.data, vm.size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
 cm_inline b32 
 cm_vm_free(cmVirtualMemory vm) {
 	MEMORY_BASIC_INFORMATION info;
 	while (vm.size > 0) {
+		isize alloc_size = 0;
+		void *p = vm.data;
 		if (VirtualQuery(vm.data, &info, cm_size_of(info)) == 0)
 			return false;
 		if (info.BaseAddress != vm.data ||
-		    info.AllocationBase != vm.data ||
-		    info.State != MEM_COMMIT || info.RegionSize > cast(usize)vm.size) {
+		    info.AllocationBase != vm.data) {
 			return false;
 		}
+		// NOTE: A reservation may only be partly committed, so walk all of its regions
+		while (VirtualQuery(p, &info, cm_size_of(info)) != 0 &&
+		       info.AllocationBase == vm.data && info.State != MEM_FREE) {
+			alloc_size += info.RegionSize;
+			p = cm_pointer_add(p, info.RegionSize);
+		}
+		if (alloc_size > vm.size)
+			return false;
 		if (VirtualFree(vm.data, 0, MEM_RELEASE) == 0)
 			return false;
-		vm.data = cm_pointer_add(vm.data, info.RegionSize);
-		vm.size -= info.RegionSize;
+		vm.data = cm_pointer_add(vm.data, alloc_size);
+		vm.size -= alloc_size;
 	}
 	return true;
 }
@@ -672,21 +1586,68 @@ cm_virtual_memory_page_size(isize *alignment_out) {
 	return info.dwPageSize;
 }
 
+isize
+cm_vm_huge_page_size(void) {
+	isize size = cast(isize)GetLargePageMinimum();
+	return size > 0 ? size : CM_HUGE_PAGE_SIZE;
+}
+
+cmVirtualMemory
+cm_vm_alloc_flags(void *addr, isize size, u32 flags) {
+	if (flags & cmVirtualMemoryFlag_HugePages) {
+		// NOTE: Needs SeLockMemoryPrivilege, without it the normal path below is taken
+		isize huge = cm_vm_huge_page_size();
+		isize huge_size = (size + huge - 1) & ~(huge - 1);
+		void *data = VirtualAlloc(addr, huge_size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (data)
+			return cm_virtual_memory(data, huge_size);
+	}
+	return cm_vm_alloc(addr, size);
+}
+
+cm_inline b32
+cm_vm_advise_huge_pages(cmVirtualMemory vm) {
+	cm_unused(vm);
+	return false;
+}
+
 #else
 
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
 cm_inline cmVirtualMemory 
 cm_vm_alloc(void *addr, isize size) {
 	cmVirtualMemory vm;
 	CM_ASSERT(size > 0);
 	vm.data = mmap(addr, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (vm.data == MAP_FAILED)
+		vm.data = NULL;
+	vm.size = size;
+	return vm;
+}
+
+cm_inline cmVirtualMemory 
+cm_vm_reserve(void *addr, isize size) {
+	cmVirtualMemory vm;
+	CM_ASSERT(size > 0);
+	vm.data = mmap(addr, size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+	if (vm.data == MAP_FAILED)
+		vm.data = NULL;
 	vm.size = size;
 	return vm;
 }
 
+cm_inline b32 
+cm_vm_commit(cmVirtualMemory vm) {
+	return mprotect(vm.data, vm.size, PROT_READ | PROT_WRITE) == 0;
+}
+
 cm_inline b32 
 cm_vm_free(cmVirtualMemory vm) {
 	munmap(vm.data, vm.size);
@@ -705,7 +1666,7 @@ cm_vm_trim(cmVirtualMemory vm, isize lead_size, isize size) {
 	if (lead_size != 0)
 		cm_vm_free(cm_virtual_memory(vm.data, lead_size));
 	if (trail_size != 0)
-		cm_vm_free(cm_virtual_memory(ptr, trail_size));
+		cm_vm_free(cm_virtual_memory(cm_pointer_add(ptr, size), trail_size));
 	return cm_virtual_memory(ptr, size);
 
 }
@@ -713,7 +1674,7 @@ cm_vm_trim(cmVirtualMemory vm, isize lead_size, isize size) {
 cm_inline b32 
 cm_vm_purge(cmVirtualMemory vm) {
 	int err = madvise(vm.data, vm.size, MADV_DONTNEED);
-	return err != 0;
+	return err == 0;
 }
 
 isize 
@@ -724,6 +1685,283 @@ cm_virtual_memory_page_size(isize *alignment_out) {
 	return result;
 }
 
+// NOTE: For /proc and /sys files, returns the length read and always NUL terminates
+cm_internal isize
+cm__read_small_file(char const *path, char *buf, isize size) {
+	isize len = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		len = read(fd, buf, size-1);
+		close(fd);
+	}
+	if (len < 0)
+		len = 0;
+	buf[len] = '\0';
+	return len;
+}
+
+cm_global isize cm__vm_huge_page_size;
+
+isize
+cm_vm_huge_page_size(void) {
+	isize size = cm__vm_huge_page_size;
+	if (size == 0) {
+	#if defined(CM_SYS_LINUX)
+		// NOTE: "Hugepagesize:    2048 kB"
+		char buf[4096];
+		isize len = cm__read_small_file("/proc/meminfo", buf, cm_size_of(buf));
+		if (len > 0) {
+			char const *line, *key = "Hugepagesize:";
+			for (line = buf; line && *line; ) {
+				if (cm_strncmp(line, key, cm_strlen(key)) == 0) {
+					char const *p = line + cm_strlen(key);
+					isize kb = 0;
+					while (*p == ' ' || *p == '\t') p++;
+					while (*p >= '0' && *p <= '9') kb = 10*kb + (*p++ - '0');
+					size = kb * 1024;
+					break;
+				}
+				line = cast(char const *)cm_memchr(line, '\n', buf + len - line);
+				if (line) line++;
+			}
+		}
+	#endif
+		if (size <= 0 || !cm_is_power_of_two(size))
+			size = CM_HUGE_PAGE_SIZE;
+		cm__vm_huge_page_size = size;
+	}
+	return size;
+}
+
+cm_inline b32
+cm_vm_advise_huge_pages(cmVirtualMemory vm) {
+#if defined(MADV_HUGEPAGE)
+	return madvise(vm.data, vm.size, MADV_HUGEPAGE) == 0;
+#else
+	cm_unused(vm);
+	return false;
+#endif
+}
+
+cmVirtualMemory
+cm_vm_alloc_flags(void *addr, isize size, u32 flags) {
+	isize huge = cm_vm_huge_page_size();
+#if defined(MAP_HUGETLB)
+	if (flags & cmVirtualMemoryFlag_HugePages) {
+		isize huge_size = (size + huge - 1) & ~(huge - 1);
+		void *data = mmap(addr, huge_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+		if (data != MAP_FAILED)
+			return cm_virtual_memory(data, huge_size);
+		// NOTE: No huge pages reserved (vm.nr_hugepages), try transparent ones instead
+	}
+#endif
+	if ((flags & (cmVirtualMemoryFlag_HugePages|cmVirtualMemoryFlag_TransparentHugePages)) &&
+	    addr == NULL && size >= huge) {
+		cmVirtualMemory vm = cm_vm_alloc_aligned(size, huge, cmVirtualMemoryFlag_TransparentHugePages);
+		if (vm.data)
+			return vm;
+	}
+	return cm_vm_alloc(addr, size);
+}
+
+#endif
+
+cmVirtualMemory
+cm_vm_alloc_aligned(isize size, isize alignment, u32 flags) {
+	cmVirtualMemory vm;
+	isize lead;
+
+	CM_ASSERT(cm_is_power_of_two(alignment));
+	if ((flags & cmVirtualMemoryFlag_HugePages) && alignment <= cm_vm_huge_page_size()) {
+		// NOTE: Huge page mappings are aligned to the huge page size already, but without huge
+		// pages cm_vm_alloc_flags falls back to a plain mapping that may not be
+		vm = cm_vm_alloc_flags(NULL, size, flags);
+		if (vm.data == NULL || (cast(uintptr)vm.data & (alignment-1)) == 0)
+			return vm;
+		cm_vm_free(vm);
+	}
+
+	vm = cm_vm_alloc(NULL, size + alignment);
+	if (vm.data == NULL)
+		return vm;
+	lead = cm_pointer_diff(vm.data, cm_align_forward(vm.data, alignment));
+	vm = cm_vm_trim(vm, lead, size);
+	if (vm.data && (flags & (cmVirtualMemoryFlag_HugePages|cmVirtualMemoryFlag_TransparentHugePages)))
+		cm_vm_advise_huge_pages(vm);
+	return vm;
+}
+
+//
+// NUMA
+//
+
+#if defined(CM_SYS_LINUX)
+#include <sched.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT   0
+#define MPOL_PREFERRED 1
+#endif
+
+cm_global isize          cm__numa_node_count;
+cm_global u8             cm__numa_cpu_node[CM_NUMA_MAX_CPUS];
+cm_global pthread_once_t cm__numa_once = PTHREAD_ONCE_INIT;
+
+// NOTE: Next range of a sysfs list such as "0-3,8,10-11", false at the end
+cm_internal b32
+cm__numa_next_range(char const **list, isize *lo, isize *hi) {
+	char const *p = *list;
+	while (*p == ',' || *p == ' ') p++;
+	if (*p < '0' || *p > '9')
+		return false;
+	for (*lo = 0; *p >= '0' && *p <= '9'; p++) *lo = 10 * *lo + (*p - '0');
+	*hi = *lo;
+	if (*p == '-')
+		for (p++, *hi = 0; *p >= '0' && *p <= '9'; p++) *hi = 10 * *hi + (*p - '0');
+	*list = p;
+	return true;
+}
+
+cm_internal void
+cm__numa_init(void) {
+	char online[2048], cpus[2048], path[64];
+	char const *nodes, *list;
+	isize lo, hi, cpu_lo, cpu_hi, node, cpu, count = 0;
+
+	cm__read_small_file("/sys/devices/system/node/online", online, cm_size_of(online));
+	for (nodes = online; cm__numa_next_range(&nodes, &lo, &hi); ) {
+		for (node = lo; node <= hi && node < CM_NUMA_MAX_NODES; node++) {
+			cm_snprintf(path, cm_size_of(path), "/sys/devices/system/node/node%td/cpulist", node);
+			if (cm__read_small_file(path, cpus, cm_size_of(cpus)) <= 0)
+				continue;
+			for (list = cpus; cm__numa_next_range(&list, &cpu_lo, &cpu_hi); ) {
+				for (cpu = cpu_lo; cpu <= cpu_hi && cpu < CM_NUMA_MAX_CPUS; cpu++)
+					cm__numa_cpu_node[cpu] = cast(u8)node;
+			}
+			count = node+1;
+		}
+	}
+	// NOTE: No sysfs node directory (kernels without NUMA support) means one node
+	cm__numa_node_count = CM_MAX(count, 1);
+}
+
+isize
+cm_numa_node_count(void) {
+	pthread_once(&cm__numa_once, cm__numa_init);
+	return cm__numa_node_count;
+}
+
+isize
+cm_numa_current_node(void) {
+	int cpu;
+	if (cm_numa_node_count() <= 1)
+		return 0;
+	cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= CM_NUMA_MAX_CPUS)
+		return 0;
+	return cm__numa_cpu_node[cpu];
+}
+
+b32
+cm_numa_set_thread_node(isize node) {
+	u64 mask;
+	if (node == CM_NUMA_CURRENT_NODE)
+		node = cm_numa_current_node();
+	if (node < 0)
+		return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0) == 0;
+	if (node >= cm_numa_node_count())
+		return false;
+	mask = cast(u64)1 << node;
+	return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, CM_NUMA_MAX_NODES+1) == 0;
+}
+
+b32
+cm_vm_bind_node(cmVirtualMemory vm, isize node) {
+	u64 mask;
+	if (node == CM_NUMA_CURRENT_NODE)
+		node = cm_numa_current_node();
+	if (vm.data == NULL || node < 0 || node >= cm_numa_node_count())
+		return false;
+	mask = cast(u64)1 << node;
+	return syscall(SYS_mbind, vm.data, vm.size, MPOL_PREFERRED, &mask, CM_NUMA_MAX_NODES+1, 0) == 0;
+}
+
+cmVirtualMemory
+cm_vm_alloc_node(isize size, isize node) {
+	cmVirtualMemory vm = cm_vm_alloc(NULL, size);
+	if (vm.data && cm_numa_node_count() > 1)
+		cm_vm_bind_node(vm, node);
+	return vm;
+}
+
+#elif defined(CM_SYS_WINDOWS)
+
+isize
+cm_numa_node_count(void) {
+	ULONG highest = 0;
+	if (!GetNumaHighestNodeNumber(&highest))
+		return 1;
+	return CM_MIN(cast(isize)highest + 1, CM_NUMA_MAX_NODES);
+}
+
+isize
+cm_numa_current_node(void) {
+	UCHAR node = 0;
+	if (!GetNumaProcessorNode(cast(UCHAR)GetCurrentProcessorNumber(), &node) || node == 0xff)
+		return 0;
+	return node;
+}
+
+b32
+cm_numa_set_thread_node(isize node) {
+	// NOTE: Windows places pages on the node of the thread that touches them first
+	cm_unused(node);
+	return false;
+}
+
+b32
+cm_vm_bind_node(cmVirtualMemory vm, isize node) {
+	// NOTE: The node can only be picked when the memory is allocated, see cm_vm_alloc_node
+	cm_unused(vm); cm_unused(node);
+	return false;
+}
+
+cmVirtualMemory
+cm_vm_alloc_node(isize size, isize node) {
+	cmVirtualMemory vm;
+	if (node == CM_NUMA_CURRENT_NODE)
+		node = cm_numa_current_node();
+	if (node < 0 || node >= cm_numa_node_count() || cm_numa_node_count() <= 1)
+		return cm_vm_alloc(NULL, size);
+	vm.data = VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE, cast(DWORD)node);
+	vm.size = size;
+	return vm;
+}
+
+#else
+
+isize cm_numa_node_count  (void) { return 1; }
+isize cm_numa_current_node(void) { return 0; }
+
+b32
+cm_numa_set_thread_node(isize node) {
+	cm_unused(node);
+	return false;
+}
+
+b32
+cm_vm_bind_node(cmVirtualMemory vm, isize node) {
+	cm_unused(vm); cm_unused(node);
+	return false;
+}
+
+cmVirtualMemory
+cm_vm_alloc_node(isize size, isize node) {
+	cm_unused(node);
+	return cm_vm_alloc(NULL, size);
+}
+
 #endif
 
 /////////////////////////////////////////////////////////////////
@@ -739,6 +1977,11 @@ cm_arena_init_from_memory(cmArena *arena, void *start, isize size) {
 	arena->total_size      = size;
 	arena->total_allocated = 0;
 	arena->temp_count      = 0;
+	arena->last_alloc      = NULL;
+	arena->is_virtual      = false;
+	arena->committed       = size;
+	arena->high_water_mark = size;
+	arena->peak_allocated  = 0;
 }
 
 cm_inline void 
@@ -748,6 +1991,50 @@ cm_arena_init_from_allocator(cmArena *arena, cmAllocator backing, isize size) {
 	arena->total_size      = size;
 	arena->total_allocated = 0;
 	arena->temp_count      = 0;
+	arena->last_alloc      = NULL;
+	arena->is_virtual      = false;
+	arena->committed       = size;
+	arena->high_water_mark = size;
+	arena->peak_allocated  = 0;
+}
+
+b32 
+cm_arena_init_virtual(cmArena *arena, isize reserve_size, isize high_water_mark) {
+	isize page_size = cm_virtual_memory_page_size(NULL);
+	cmVirtualMemory vm;
+
+	reserve_size    = (reserve_size + page_size - 1) & ~(page_size - 1);
+	high_water_mark = (high_water_mark + page_size - 1) & ~(page_size - 1);
+	vm = cm_vm_reserve(NULL, reserve_size);
+
+	arena->backing.proc    = NULL;
+	arena->backing.data    = NULL;
+	arena->physical_start  = vm.data;
+	arena->total_size      = vm.data ? reserve_size : 0;
+	arena->total_allocated = 0;
+	arena->temp_count      = 0;
+	arena->last_alloc      = NULL;
+	arena->is_virtual      = true;
+	arena->committed       = 0;
+	arena->high_water_mark = CM_MIN(high_water_mark, arena->total_size);
+	arena->peak_allocated  = 0;
+	return vm.data != NULL;
+}
+
+// NOTE: Makes sure the first `size` bytes of a virtual arena are committed
+cm_internal b32 
+cm__arena_commit(cmArena *arena, isize size) {
+	isize new_committed;
+	if (size <= arena->committed)
+		return true;
+	new_committed = (size + CM_ARENA_COMMIT_SIZE - 1) & ~(CM_ARENA_COMMIT_SIZE - 1);
+	new_committed = CM_MIN(new_committed, arena->total_size);
+	if (!cm_vm_commit(cm_virtual_memory(cm_pointer_add(arena->physical_start, arena->committed),
+	                                    new_committed - arena->committed))) {
+		return false;
+	}
+	arena->committed = new_committed;
+	return true;
 }
 
 cm_inline void 
@@ -757,7 +2044,11 @@ cm_arena_init_sub(cmArena *arena, cmArena *parent_arena, isize size) {
 
 cm_inline void 
 cm_arena_free(cmArena *arena) {
-	if (arena->backing.proc) {
+	if (arena->is_virtual) {
+		if (arena->physical_start)
+			cm_vm_free(cm_virtual_memory(arena->physical_start, arena->total_size));
+		arena->physical_start = NULL;
+	} else if (arena->backing.proc) {
 		cm_free(arena->backing, arena->physical_start);
 		arena->physical_start = NULL;
 	}
@@ -786,6 +2077,23 @@ cm_arena_size_remaining(cmArena *arena, isize alignment) {
 cm_inline void 
 cm_arena_check(cmArena *arena) { CM_ASSERT(arena->temp_count == 0); }
 
+b32 
+cm_arena_try_extend(cmArena *arena, void *ptr, isize new_size) {
+	isize new_total;
+	if (ptr == NULL || ptr != arena->last_alloc)
+		return false;
+
+	new_total = cm_pointer_diff(arena->physical_start, ptr) + new_size;
+	if (new_total > arena->total_size)
+		return false;
+	if (arena->is_virtual && !cm__arena_commit(arena, new_total))
+		return false;
+
+	arena->total_allocated = new_total;
+	arena->peak_allocated  = CM_MAX(arena->peak_allocated, new_total);
+	return true;
+}
+
 cm_inline cmAllocator 
 cm_arena_allocator(cmArena *arena) {
 	cmAllocator allocator;
@@ -810,9 +2118,15 @@ CM_ALLOCATOR_PROC(cm_arena_allocator_proc) {
 			cm_printf_err("Arena out of memory\n");
 			return NULL;
 		}
+		if (arena->is_virtual && !cm__arena_commit(arena, arena->total_allocated + total_size)) {
+			cm_printf_err("Arena failed to commit memory\n");
+			return NULL;
+		}
 
 		ptr = cm_align_forward(end, alignment);
 		arena->total_allocated += total_size;
+		arena->peak_allocated   = CM_MAX(arena->peak_allocated, arena->total_allocated);
+		arena->last_alloc = ptr;
 		if (flags & cmAllocatorFlag_ClearToZero)
 			cm_zero_size(ptr, size);
 	} break;
@@ -820,17 +2134,38 @@ CM_ALLOCATOR_PROC(cm_arena_allocator_proc) {
 	case cmAllocation_Free:
 		// NOTE(bill): Free all at once
 		// Use Temp_Arena_Memory if you want to free a block
+		// NOTE: Except for the top allocation, which is just popped
+		if (old_memory != NULL && old_memory == arena->last_alloc) {
+			arena->total_allocated = cm_pointer_diff(arena->physical_start, old_memory);
+			arena->last_alloc = NULL;
+		}
 		break;
 
 	case cmAllocation_FreeAll:
 		arena->total_allocated = 0;
+		arena->last_alloc = NULL;
+		// NOTE: Only the pages used since the last purge, the ones above them are already gone
+		if (arena->is_virtual && arena->peak_allocated > arena->high_water_mark) {
+			isize end = (arena->peak_allocated + CM_ARENA_COMMIT_SIZE - 1) & ~(CM_ARENA_COMMIT_SIZE - 1);
+			end = CM_MIN(end, arena->committed);
+			cm_vm_purge(cm_virtual_memory(cm_pointer_add(arena->physical_start, arena->high_water_mark),
+			                              end - arena->high_water_mark));
+		}
+		arena->peak_allocated = 0;
 		break;
 
 	case cmAllocation_Resize: {
-		// TODO(bill): Check if ptr is on top of stack and just extend
 		cmAllocator a = cm_arena_allocator(arena);
+		if (size > 0 && (cast(uintptr)old_memory & (alignment-1)) == 0 &&
+		    cm_arena_try_extend(arena, old_memory, size)) {
+			ptr = old_memory;
+			break;
+		}
 		ptr = cm_default_resize_align(a, old_memory, old_size, size, alignment);
 	} break;
+
+	default:
+		break;
 	}
 	return ptr;
 }
@@ -842,6 +2177,7 @@ cm_temp_arena_memory_begin(cmArena *arena) {
 	tmp.arena = arena;
 	tmp.original_count = arena->total_allocated;
 	arena->temp_count++;
+	arena->last_alloc = NULL; // NOTE: Growing an older block would outlive the rewind
 	return tmp;
 }
 
@@ -851,6 +2187,7 @@ cm_temp_arena_memory_end(cmTempArenaMemory tmp) {
 	              "%td >= %td", tmp.arena->total_allocated, tmp.original_count);
 	CM_ASSERT(tmp.arena->temp_count > 0);
 	tmp.arena->total_allocated = tmp.original_count;
+	tmp.arena->last_alloc = NULL;
 	tmp.arena->temp_count--;
 }
 
@@ -942,6 +2279,38 @@ CM_ALLOCATOR_PROC(cm_pool_allocator_proc) {
 		pool->total_size -= pool->block_size;
 	} break;
 
+	case cmAllocation_AllocBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i;
+		CM_ASSERT(size      == pool->block_size);
+		CM_ASSERT(alignment == pool->block_align);
+		for (i = 0; i < old_size && pool->free_list != NULL; i++) {
+			ptrs[i] = pool->free_list;
+			pool->free_list = *cast(void **)pool->free_list;
+			if (flags & cmAllocatorFlag_ClearToZero)
+				cm_zero_size(ptrs[i], size);
+		}
+		pool->total_size += i * pool->block_size;
+		if (i == old_size)
+			ptr = ptrs;
+	} break;
+
+	case cmAllocation_FreeBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i;
+		for (i = 0; i < old_size; i++) {
+			if (ptrs[i] == NULL) continue;
+			*cast(void **)ptrs[i] = pool->free_list;
+			pool->free_list = ptrs[i];
+			pool->total_size -= pool->block_size;
+		}
+		ptr = ptrs;
+	} break;
+
+	case cmAllocation_UsableSize:
+		ptr = cast(u8 *)old_memory + pool->block_size;
+		break;
+
 	case cmAllocation_FreeAll:
 		// TODO(bill):
 		break;
@@ -955,265 +2324,2562 @@ CM_ALLOCATOR_PROC(cm_pool_allocator_proc) {
 	return ptr;
 }
 
-cm_inline cmAllocationHeader *
-cm_allocation_header(void *data) {
-	isize *p = cast(isize *)data;
-	while (p[-1] == cast(isize)(-1)) {
-		p--;
-	}
-	return cast(cmAllocationHeader *)p - 1;
-}
-
-cm_inline void 
-cm_allocation_header_fill(cmAllocationHeader *header, void *data, isize size) {
-	isize *ptr;
-	header->size = size;
-	ptr = cast(isize *)(header + 1);
-	while (cast(void *)ptr < data) {
-		*ptr++ = cast(isize)(-1);
-	}
-}
 
-///////////////////////////////////////////////////////////////////////
 //
-// Free List Allocator
+// Concurrent Pool Allocator
 //
 
-cm_inline void 
-cm_free_list_init(cmFreeList *fl, void *start, isize size) {
-	CM_ASSERT(size > cm_size_of(cmFreeListBlock));
+// NOTE: The depot heads pack a generation tag with the pointer so that a pop which
+// raced with pop/push/pop of the same magazine fails its compare exchange (ABA).
+// 64-bit user space pointers fit in 48 bits, leaving 16 bits of tag.
+#if defined(CM_ARCH_64)
+#define CM__POOL_TAG_SHIFT 48
+#else
+#define CM__POOL_TAG_SHIFT 32
+#endif
+#define CM__POOL_PTR_MASK ((cast(u64)1 << CM__POOL_TAG_SHIFT) - 1)
 
-	fl->physical_start   = start;
-	fl->total_size       = size;
-	fl->curr_block       = cast(cmFreeListBlock *)start;
-	fl->curr_block->size = size;
-	fl->curr_block->next = NULL;
+CM_STATIC_ASSERT(CM_POOL_MAX_THREADS <= 64);
+
+cm_global cmAtomic64 cm__pool_thread_slots; // NOTE: One bit per slot in use
+cm_global cm_thread_local isize cm__pool_thread_slot; // NOTE: slot+1, 0 if not assigned yet
+
+#if !defined(CM_SYS_WINDOWS)
+cm_global pthread_key_t  cm__pool_thread_key;
+cm_global pthread_once_t cm__pool_thread_key_once = PTHREAD_ONCE_INIT;
+
+cm_internal void
+cm__pool_thread_destructor(void *slot) {
+	u64 bit = cast(u64)1 << (cast(isize)cast(intptr)slot - 1);
+	cm_atomic64_fetch_and(&cm__pool_thread_slots, cast(i64)~bit);
 }
 
-cm_inline void 
-cm_free_list_init_from_allocator(cmFreeList *fl, cmAllocator backing, isize size) {
-	void *start = cm_alloc(backing, size);
-	cm_free_list_init(fl, start, size);
+cm_internal void
+cm__pool_thread_key_init(void) {
+	pthread_key_create(&cm__pool_thread_key, cm__pool_thread_destructor);
 }
+#endif
 
-cm_inline cmAllocator 
-cm_free_list_allocator(cmFreeList *fl) {
-	cmAllocator a;
-	a.proc = cm_free_list_allocator_proc;
-	a.data = fl;
-	return a;
+// NOTE: Returns -1 when every slot is taken, such threads use the depot directly
+cm_internal isize
+cm__pool_thread_slot_get(void) {
+	isize slot = cm__pool_thread_slot;
+	if (slot == 0) {
+		for (;;) {
+			u64 used = cast(u64)cm_atomic64_load(&cm__pool_thread_slots);
+			u64 bit;
+			if (used == ~cast(u64)0) {
+				return -1;
+			}
+			slot = cm__bit_lsb(~used);
+			bit  = cast(u64)1 << slot;
+			if ((cast(u64)cm_atomic64_fetch_or(&cm__pool_thread_slots, cast(i64)bit) & bit) == 0) {
+				break;
+			}
+		}
+		cm__pool_thread_slot = ++slot;
+	#if !defined(CM_SYS_WINDOWS)
+		pthread_once(&cm__pool_thread_key_once, cm__pool_thread_key_init);
+		pthread_setspecific(cm__pool_thread_key, cast(void *)cast(intptr)slot);
+	#endif
+	}
+	return slot-1;
 }
 
-CM_ALLOCATOR_PROC(cm_free_list_allocator_proc) {
-	cmFreeList *fl = cast(cmFreeList *)allocator_data;
-	void *ptr = NULL;
+cm_internal void
+cm__pool_depot_push(cmAtomic64 volatile *head, cmPoolMagazine *m) {
+	for (;;) {
+		i64 old_head = cm_atomic64_load(head);
+		u64 tag = (cast(u64)old_head >> CM__POOL_TAG_SHIFT) + 1;
+		i64 new_head = cast(i64)((tag << CM__POOL_TAG_SHIFT) | cast(u64)cast(uintptr)m);
+		m->next = cast(cmPoolMagazine *)cast(uintptr)(cast(u64)old_head & CM__POOL_PTR_MASK);
+		if (cm_atomic64_compare_exchange(head, old_head, new_head) == old_head) {
+			return;
+		}
+	}
+}
 
-	CM_ASSERT_NOT_NULL(fl);
+// NOTE: Magazines are only released by cm_concurrent_pool_free, so reading m->next
+// of a magazine that another thread has just popped is safe, the tag rejects it
+cm_internal cmPoolMagazine *
+cm__pool_depot_pop(cmAtomic64 volatile *head) {
+	for (;;) {
+		i64 old_head = cm_atomic64_load(head);
+		u64 tag = (cast(u64)old_head >> CM__POOL_TAG_SHIFT) + 1;
+		cmPoolMagazine *m = cast(cmPoolMagazine *)cast(uintptr)(cast(u64)old_head & CM__POOL_PTR_MASK);
+		i64 new_head;
+		if (m == NULL) {
+			return NULL;
+		}
+		new_head = cast(i64)((tag << CM__POOL_TAG_SHIFT) | cast(u64)cast(uintptr)m->next);
+		if (cm_atomic64_compare_exchange(head, old_head, new_head) == old_head) {
+			return m;
+		}
+	}
+}
 
-	switch (type) {
-	case cmAllocation_Alloc: {
-		cmFreeListBlock *prev_block = NULL;
-		cmFreeListBlock *curr_block = fl->curr_block;
+cm_internal cmPoolMagazine *
+cm__pool_magazine_get(cmConcurrentPool *pool) {
+	cmPoolMagazine *m = cm__pool_depot_pop(&pool->empty);
+	if (m == NULL) {
+		m = cast(cmPoolMagazine *)cm_alloc_align(pool->backing, cm_size_of(cmPoolMagazine), CM_CACHE_LINE_SIZE);
+		if (m == NULL) {
+			return NULL;
+		}
+		m->count = 0;
+		for (;;) {
+			void *all = cm_atomic_ptr_load(&pool->magazines);
+			m->all_next = cast(cmPoolMagazine *)all;
+			if (cm_atomic_ptr_compare_exchange(&pool->magazines, all, m) == all) {
+				break;
+			}
+		}
+	}
+	CM_ASSERT(m->count == 0);
+	return m;
+}
 
-		while (curr_block) {
-			isize total_size;
-			cmAllocationHeader *header;
+// NOTE: Carves a new chunk into full magazines, returns one of them and pushes the rest
+cm_internal cmPoolMagazine *
+cm__pool_grow(cmConcurrentPool *pool) {
+	isize header = (cm_size_of(void *) + pool->block_align - 1) & ~(pool->block_align - 1);
+	isize i, count = pool->chunk_blocks;
+	cmPoolMagazine *first = NULL, *m = NULL;
+	u8 *chunk, *block;
 
-			total_size = size + alignment + cm_size_of(cmAllocationHeader);
+	chunk = cast(u8 *)cm_alloc_align(pool->backing, header + count*pool->block_stride, pool->block_align);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	for (;;) {
+		void *chunks = cm_atomic_ptr_load(&pool->chunks);
+		*cast(void **)chunk = chunks;
+		if (cm_atomic_ptr_compare_exchange(&pool->chunks, chunks, chunk) == chunks) {
+			break;
+		}
+	}
 
-			if (curr_block->size < total_size) {
-				prev_block = curr_block;
-				curr_block = curr_block->next;
-				continue;
+	block = chunk + header;
+	for (i = 0; i < count; i++) {
+		if (m == NULL || m->count == CM_POOL_MAGAZINE_SIZE) {
+			if (m != NULL && m != first) {
+				cm__pool_depot_push(&pool->full, m);
+			}
+			m = cm__pool_magazine_get(pool);
+			if (m == NULL) {
+				// NOTE: The rest of the chunk stays unused until the pool is freed
+				break;
+			}
+			if (first == NULL) {
+				first = m;
 			}
+		}
+		m->blocks[m->count++] = block;
+		block += pool->block_stride;
+	}
+	if (m != NULL && m != first) {
+		cm__pool_depot_push(&pool->full, m);
+	}
+	return first;
+}
 
-			if (curr_block->size - total_size <= cm_size_of(cmAllocationHeader)) {
-				total_size = curr_block->size;
+cm_inline void
+cm_concurrent_pool_init(cmConcurrentPool *pool, cmAllocator backing, isize chunk_blocks, isize block_size) {
+	cm_concurrent_pool_init_align(pool, backing, chunk_blocks, block_size, CM_DEFAULT_MEMORY_ALIGNMENT);
+}
 
-				if (prev_block)
-					prev_block->next = curr_block->next;
-				else
-					fl->curr_block = curr_block->next;
-			} else {
-				// NOTE(bill): Create a new block for the remaining memory
-				cmFreeListBlock *next_block;
-				next_block = cast(cmFreeListBlock *)cm_pointer_add(curr_block, total_size);
+void
+cm_concurrent_pool_init_align(cmConcurrentPool *pool, cmAllocator backing, isize chunk_blocks, isize block_size, isize block_align) {
+	isize caches_size = CM_POOL_MAX_THREADS * cm_size_of(cmPoolThreadCache);
 
-				CM_ASSERT(cast(void *)next_block < cm_pointer_add(fl->physical_start, fl->total_size));
+	CM_ASSERT(cm_is_power_of_two(block_align));
+	CM_ASSERT(chunk_blocks > 0);
 
-				next_block->size = curr_block->size - total_size;
-				next_block->next = curr_block->next;
+	cm_zero_item(pool);
 
-				if (prev_block)
-					prev_block->next = next_block;
-				else
-					fl->curr_block = next_block;
-			}
+	pool->backing      = backing;
+	pool->block_size   = block_size;
+	pool->block_align  = block_align;
+	pool->block_stride = (CM_MAX(block_size, cm_size_of(void *)) + block_align - 1) & ~(block_align - 1);
+	pool->chunk_blocks = chunk_blocks;
 
+	pool->caches = cast(cmPoolThreadCache *)cm_alloc_align(backing, caches_size, CM_CACHE_LINE_SIZE);
+	cm_zero_size(pool->caches, caches_size);
+}
 
-			// TODO(bill): Set Header Info
-			header = cast(cmAllocationHeader *)curr_block;
-			ptr = cm_align_forward(header+1, alignment);
-			cm_allocation_header_fill(header, ptr, size);
+void
+cm_concurrent_pool_free(cmConcurrentPool *pool) {
+	void *chunk;
+	cmPoolMagazine *m;
 
-			fl->total_allocated += total_size;
-			fl->allocation_count++;
+	if (pool->backing.proc == NULL) {
+		return;
+	}
 
+	chunk = cm_atomic_ptr_load(&pool->chunks);
+	while (chunk) {
+		void *next = *cast(void **)chunk;
+		cm_free(pool->backing, chunk);
+		chunk = next;
+	}
 
-			if (flags & cmAllocatorFlag_ClearToZero)
-				cm_zero_size(ptr, size);
-			return ptr;
+	m = cast(cmPoolMagazine *)cm_atomic_ptr_load(&pool->magazines);
+	while (m) {
+		cmPoolMagazine *next = m->all_next;
+		cm_free(pool->backing, m);
+		m = next;
+	}
+
+	cm_free(pool->backing, pool->caches);
+	cm_zero_item(pool);
+}
+
+cm_inline cmAllocator
+cm_concurrent_pool_allocator(cmConcurrentPool *pool) {
+	cmAllocator allocator;
+	allocator.proc = cm_concurrent_pool_allocator_proc;
+	allocator.data = pool;
+	return allocator;
+}
+
+cm_internal void *
+cm__concurrent_pool_alloc(cmConcurrentPool *pool) {
+	isize slot = cm__pool_thread_slot_get();
+	cmPoolMagazine *m;
+	void *ptr;
+
+	if (slot >= 0) {
+		cmPoolThreadCache *c = &pool->caches[slot];
+		if (c->loaded && c->loaded->count > 0) {
+			return c->loaded->blocks[--c->loaded->count];
+		}
+		if (c->previous && c->previous->count > 0) {
+			cmPoolMagazine *t = c->loaded;
+			c->loaded   = c->previous;
+			c->previous = t;
+			return c->loaded->blocks[--c->loaded->count];
 		}
-		// NOTE(bill): if ptr == NULL, ran out of free list memory! FUCK!
-		return NULL;
-	} break;
 
-	case cmAllocation_Free: {
-		cmAllocationHeader *header = cm_allocation_header(old_memory);
-		isize block_size = header->size;
-		uintptr block_start, block_end;
-		cmFreeListBlock *prev_block = NULL;
-		cmFreeListBlock *curr_block = fl->curr_block;
+		m = cm__pool_depot_pop(&pool->full);
+		if (m == NULL) {
+			m = cm__pool_grow(pool);
+			if (m == NULL) {
+				return NULL;
+			}
+		}
+		// NOTE: Both magazines are empty here, keep one for the next free
+		if (c->previous) {
+			cm__pool_depot_push(&pool->empty, c->previous);
+		}
+		c->previous = c->loaded;
+		c->loaded   = m;
+		return m->blocks[--m->count];
+	}
 
-		block_start = cast(uintptr)header;
-		block_end   = cast(uintptr)block_start + block_size;
+	m = cm__pool_depot_pop(&pool->full);
+	if (m == NULL) {
+		m = cm__pool_grow(pool);
+		if (m == NULL) {
+			return NULL;
+		}
+	}
+	ptr = m->blocks[--m->count];
+	cm__pool_depot_push(m->count > 0 ? &pool->full : &pool->empty, m);
+	return ptr;
+}
 
-		while (curr_block) {
-			if (cast(uintptr)curr_block >= block_end)
-				break;
-			prev_block = curr_block;
-			curr_block = curr_block->next;
+cm_internal void
+cm__concurrent_pool_release(cmConcurrentPool *pool, void *ptr) {
+	isize slot = cm__pool_thread_slot_get();
+	cmPoolMagazine *m;
+
+	if (slot >= 0) {
+		cmPoolThreadCache *c = &pool->caches[slot];
+		if (c->loaded && c->loaded->count < CM_POOL_MAGAZINE_SIZE) {
+			c->loaded->blocks[c->loaded->count++] = ptr;
+			return;
+		}
+		if (c->previous && c->previous->count < CM_POOL_MAGAZINE_SIZE) {
+			cmPoolMagazine *t = c->loaded;
+			c->loaded   = c->previous;
+			c->previous = t;
+			c->loaded->blocks[c->loaded->count++] = ptr;
+			return;
 		}
 
-		if (prev_block == NULL) {
-			prev_block = cast(cmFreeListBlock *)block_start;
-			prev_block->size = block_size;
-			prev_block->next = fl->curr_block;
+		m = cm__pool_magazine_get(pool);
+		if (m != NULL) {
+			// NOTE: Both magazines are full here, hand one to the depot
+			if (c->previous) {
+				cm__pool_depot_push(&pool->full, c->previous);
+			}
+			c->previous = c->loaded;
+			c->loaded   = m;
+			m->blocks[m->count++] = ptr;
+			return;
+		}
+	}
 
-			fl->curr_block = prev_block;
-		} else if ((cast(uintptr)prev_block + prev_block->size) == block_start) {
-			prev_block->size += block_size;
-		} else {
-			cmFreeListBlock *tmp = cast(cmFreeListBlock *)block_start;
-			tmp->size = block_size;
-			tmp->next = prev_block->next;
-			prev_block->next = tmp;
+	// NOTE: Any magazine with room will do, full ones are skipped by taking a fresh one
+	m = cm__pool_magazine_get(pool);
+	CM_ASSERT_MSG(m != NULL, "Concurrent pool could not allocate a magazine");
+	m->blocks[m->count++] = ptr;
+	cm__pool_depot_push(&pool->full, m);
+}
 
-			prev_block = tmp;
+CM_ALLOCATOR_PROC(cm_concurrent_pool_allocator_proc) {
+	cmConcurrentPool *pool = cast(cmConcurrentPool *)allocator_data;
+	void *ptr = NULL;
+
+	cm_unused(old_size);
+
+	switch (type) {
+	case cmAllocation_Alloc:
+		CM_ASSERT(size      <= pool->block_size);
+		CM_ASSERT(alignment <= pool->block_align);
+		ptr = cm__concurrent_pool_alloc(pool);
+		if (ptr) {
+			cm_atomic64_fetch_add(&pool->total_size, pool->block_size);
+			if (flags & cmAllocatorFlag_ClearToZero)
+				cm_zero_size(ptr, size);
 		}
+		break;
 
-		if (curr_block && (cast(uintptr)curr_block == block_end)) {
-			prev_block->size += curr_block->size;
-			prev_block->next = curr_block->next;
+	case cmAllocation_Free:
+		if (old_memory == NULL) return NULL;
+		cm__concurrent_pool_release(pool, old_memory);
+		cm_atomic64_fetch_add(&pool->total_size, -pool->block_size);
+		break;
+
+	case cmAllocation_AllocBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i;
+		CM_ASSERT(size      <= pool->block_size);
+		CM_ASSERT(alignment <= pool->block_align);
+		for (i = 0; i < old_size; i++) {
+			ptrs[i] = cm__concurrent_pool_alloc(pool);
+			if (ptrs[i] == NULL)
+				break;
+			if (flags & cmAllocatorFlag_ClearToZero)
+				cm_zero_size(ptrs[i], size);
 		}
+		cm_atomic64_fetch_add(&pool->total_size, i * pool->block_size);
+		if (i == old_size)
+			ptr = ptrs;
+	} break;
 
-		fl->allocation_count--;
-		fl->total_allocated -= block_size;
+	case cmAllocation_FreeBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i, freed = 0;
+		for (i = 0; i < old_size; i++) {
+			if (ptrs[i] == NULL) continue;
+			cm__concurrent_pool_release(pool, ptrs[i]);
+			freed++;
+		}
+		cm_atomic64_fetch_add(&pool->total_size, -freed * pool->block_size);
+		ptr = ptrs;
 	} break;
 
+	case cmAllocation_UsableSize:
+		ptr = cast(u8 *)old_memory + pool->block_size;
+		break;
+
 	case cmAllocation_FreeAll:
-		cm_free_list_init(fl, fl->physical_start, fl->total_size);
+		// NOTE: Blocks may be cached by other threads, use cm_concurrent_pool_free
 		break;
 
 	case cmAllocation_Resize:
-		ptr = cm_default_resize_align(cm_free_list_allocator(fl), old_memory, old_size, size, alignment);
+		CM_PANIC("You cannot resize something allocated by with a pool.");
 		break;
 	}
 
 	return ptr;
 }
 
-void 
-cm_scratch_memory_init(cmScratchMemory *s, void *start, isize size) {
-	s->physical_start = start;
-	s->total_size     = size;
-	s->alloc_point    = start;
-	s->free_point     = start;
+
+//
+// Slab Allocator
+//
+
+#define CM__SLAB_MAX_ALIGN 4096
+#define CM__SLAB_MASK      (cast(uintptr)CM_SLAB_SIZE - 1)
+
+// NOTE: Class 0 is 16 bytes, then 2^j is class 2j-9 and 1.5*2^j is class 2j-8
+cm_internal isize
+cm__slab_class_index(isize size) {
+	isize k;
+	if (size <= 16)
+		return 0;
+	k = cm__bit_msb(cast(u64)(size-1));
+	if (k >= 5 && size <= (cast(isize)3 << (k-1)))
+		return 2*(k-4);
+	return 2*k - 7;
 }
 
-b32 
-cm_scratch_memory_is_in_use(cmScratchMemory *s, void *ptr) {
-	if (s->free_point == s->alloc_point) return false;
-	if (s->alloc_point > s->free_point)
-		return ptr >= s->free_point && ptr < s->alloc_point;
-	return ptr >= s->free_point || ptr < s->alloc_point;
+cm_internal isize
+cm__slab_set_index(cmSlabAllocator *s, cmSlab *slab) {
+	u64 key = cast(u64)(cast(uintptr)slab / CM_SLAB_SIZE);
+	return cast(isize)((key * 0x9E3779B97F4A7C15ull) >> 32) & (s->slab_capacity - 1);
 }
 
-cmAllocator 
-cm_scratch_allocator(cmScratchMemory *s) {
-	cmAllocator a;
-	a.proc = cm_scratch_allocator_proc;
-	a.data = s;
-	return a;
+cm_internal b32
+cm__slab_set_contains(cmSlabAllocator *s, cmSlab *slab) {
+	isize i;
+	if (s->slab_count == 0)
+		return false;
+	for (i = cm__slab_set_index(s, slab); s->slabs[i]; i = (i+1) & (s->slab_capacity-1)) {
+		if (s->slabs[i] == slab)
+			return true;
+	}
+	return false;
 }
 
-CM_ALLOCATOR_PROC(cm_scratch_allocator_proc) {
-	cmScratchMemory *s = cast(cmScratchMemory *)allocator_data;
+cm_internal b32
+cm__slab_set_insert(cmSlabAllocator *s, cmSlab *slab) {
+	isize i;
+	if (2*(s->slab_count+1) > s->slab_capacity) {
+		cmSlab **old_slabs = s->slabs;
+		isize old_capacity = s->slab_capacity;
+		isize new_capacity = CM_MAX(2*old_capacity, 16);
+		cmSlab **new_slabs = cast(cmSlab **)cm_alloc(s->backing, new_capacity * cm_size_of(cmSlab *));
+		if (new_slabs == NULL)
+			return false;
+		cm_zero_size(new_slabs, new_capacity * cm_size_of(cmSlab *));
+		s->slabs = new_slabs;
+		s->slab_capacity = new_capacity;
+		for (i = 0; i < old_capacity; i++) {
+			if (old_slabs[i]) {
+				isize j = cm__slab_set_index(s, old_slabs[i]);
+				while (new_slabs[j])
+					j = (j+1) & (new_capacity-1);
+				new_slabs[j] = old_slabs[i];
+			}
+		}
+		if (old_slabs)
+			cm_free(s->backing, old_slabs);
+	}
+
+	i = cm__slab_set_index(s, slab);
+	while (s->slabs[i])
+		i = (i+1) & (s->slab_capacity-1);
+	s->slabs[i] = slab;
+	s->slab_count++;
+	return true;
+}
+
+cm_internal void
+cm__slab_set_remove(cmSlabAllocator *s, cmSlab *slab) {
+	isize mask = s->slab_capacity-1;
+	isize i = cm__slab_set_index(s, slab), j;
+	while (s->slabs[i] != slab)
+		i = (i+1) & mask;
+
+	// NOTE: Backward shift deletion, keeps probe sequences unbroken without tombstones
+	for (j = (i+1) & mask; s->slabs[j]; j = (j+1) & mask) {
+		isize home = cm__slab_set_index(s, s->slabs[j]);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			s->slabs[i] = s->slabs[j];
+			i = j;
+		}
+	}
+	s->slabs[i] = NULL;
+	s->slab_count--;
+}
+
+cm_internal cmSlab *
+cm__slab_create(cmSlabAllocator *s, isize class_index) {
+	cmSlabClass *c = &s->classes[class_index];
+	cmSlab *slab = cast(cmSlab *)cm_vm_alloc_aligned(CM_SLAB_SIZE, CM_SLAB_SIZE, 0).data;
+	isize offset, count, i;
+	u8 *block;
+
+	if (slab == NULL)
+		return NULL;
+	if (s->numa_node >= 0)
+		cm_vm_bind_node(cm_virtual_memory(slab, CM_SLAB_SIZE), s->numa_node);
+	if (!cm__slab_set_insert(s, slab)) {
+		cmVirtualMemory vm = cm_virtual_memory(slab, CM_SLAB_SIZE);
+		cm_vm_free(vm);
+		return NULL;
+	}
+
+	cm_zero_item(slab);
+	slab->class_index = class_index;
+
+	// NOTE: Same intrusive free list as cm_pool_init_align, but blocks are packed
+	offset = (cm_size_of(cmSlab) + c->block_align - 1) & ~(c->block_align - 1);
+	count  = (CM_SLAB_SIZE - offset) / c->block_size;
+	block  = cast(u8 *)slab + offset;
+	for (i = 0; i < count-1; i++) {
+		*cast(uintptr *)block = cast(uintptr)(block + c->block_size);
+		block += c->block_size;
+	}
+	*cast(uintptr *)block = cast(uintptr)NULL;
+
+	slab->pool.physical_start = cast(u8 *)slab + offset;
+	slab->pool.free_list      = slab->pool.physical_start;
+	slab->pool.block_size     = c->block_size;
+	slab->pool.block_align    = c->block_align;
+	return slab;
+}
+
+cm_internal void
+cm__slab_release(cmSlabAllocator *s, cmSlab *slab) {
+	cm__slab_set_remove(s, slab);
+	cm_vm_free(cm_virtual_memory(slab, CM_SLAB_SIZE));
+}
+
+cm_internal void
+cm__slab_partial_link(cmSlabClass *c, cmSlab *slab) {
+	slab->prev = NULL;
+	slab->next = c->partial;
+	if (c->partial)
+		c->partial->prev = slab;
+	c->partial = slab;
+	slab->in_partial = true;
+}
+
+cm_internal void
+cm__slab_partial_unlink(cmSlabClass *c, cmSlab *slab) {
+	if (slab->prev) slab->prev->next = slab->next;
+	else            c->partial = slab->next;
+	if (slab->next) slab->next->prev = slab->prev;
+	slab->next = slab->prev = NULL;
+	slab->in_partial = false;
+}
+
+// NOTE: NULL if `ptr` did not come from a slab
+cm_internal cmSlab *
+cm__slab_of(cmSlabAllocator *s, void *ptr) {
+	cmSlab *slab = cast(cmSlab *)(cast(uintptr)ptr & ~CM__SLAB_MASK);
+	return cm__slab_set_contains(s, slab) ? slab : NULL;
+}
+
+void
+cm_slab_init(cmSlabAllocator *s, cmAllocator backing) {
+	isize i;
+	cm_zero_item(s);
+	s->backing = backing;
+	s->numa_node = -1;
+	for (i = 0; i < CM_SLAB_CLASS_COUNT; i++) {
+		cmSlabClass *c = &s->classes[i];
+		if (i == 0)        c->block_size = 16;
+		else if (i & 1)    c->block_size = cast(isize)1 << ((i+9)/2);
+		else               c->block_size = cast(isize)3 << (i/2+3);
+		c->block_align = CM_MIN(c->block_size & -c->block_size, CM__SLAB_MAX_ALIGN);
+		CM_ASSERT(cm__slab_class_index(c->block_size) == i);
+	}
+	CM_ASSERT(s->classes[CM_SLAB_CLASS_COUNT-1].block_size == CM_SLAB_MAX_SIZE);
+}
+
+void
+cm_slab_free(cmSlabAllocator *s) {
+	cm_free_all(cm_slab_allocator(s));
+	if (s->slabs)
+		cm_free(s->backing, s->slabs);
+	s->slabs = NULL;
+	s->slab_capacity = 0;
+}
+
+cm_inline cmAllocator
+cm_slab_allocator(cmSlabAllocator *s) {
+	cmAllocator allocator;
+	allocator.proc = cm_slab_allocator_proc;
+	allocator.data = s;
+	return allocator;
+}
+
+cm_internal isize
+cm__slab_class_for(cmSlabAllocator *s, isize size, isize alignment) {
+	isize class_index = cm__slab_class_index(size);
+	while (s->classes[class_index].block_align < alignment)
+		class_index++;
+	return class_index;
+}
+
+// NOTE: A slab of the class with at least one free block, on the partial list
+cm_internal cmSlab *
+cm__slab_partial_get(cmSlabAllocator *s, isize class_index) {
+	cmSlabClass *c = &s->classes[class_index];
+	cmSlab *slab = c->partial;
+	if (slab == NULL) {
+		slab = c->empty;
+		c->empty = NULL;
+		if (slab == NULL) {
+			slab = cm__slab_create(s, class_index);
+			if (slab == NULL)
+				return NULL;
+		}
+		cm__slab_partial_link(c, slab);
+	}
+	return slab;
+}
+
+CM_ALLOCATOR_PROC(cm_slab_allocator_proc) {
+	cmSlabAllocator *s = cast(cmSlabAllocator *)allocator_data;
 	void *ptr = NULL;
-	CM_ASSERT_NOT_NULL(s);
 
 	switch (type) {
 	case cmAllocation_Alloc: {
-		void *pt = s->alloc_point;
-		cmAllocationHeader *header = cast(cmAllocationHeader *)pt;
-		void *data = cm_align_forward(header+1, alignment);
-		void *end = cm_pointer_add(s->physical_start, s->total_size);
+		isize class_index;
+		cmSlabClass *c;
+		cmSlab *slab;
 
-		CM_ASSERT(alignment % 4 == 0);
-		size = ((size + 3)/4)*4;
-		pt = cm_pointer_add(pt, size);
+		if (size > CM_SLAB_MAX_SIZE || alignment > CM__SLAB_MAX_ALIGN)
+			return s->backing.proc(s->backing.data, type, size, alignment, old_memory, old_size, flags);
 
-		// NOTE(bill): Wrap around
-		if (pt > end) {
-			header->size = cm_pointer_diff(header, end) | CM_ISIZE_HIGH_BIT;
-			pt = s->physical_start;
-			header = cast(cmAllocationHeader *)pt;
-			data = cm_align_forward(header+1, alignment);
-			pt = cm_pointer_add(pt, size);
-		}
+		class_index = cm__slab_class_for(s, size, alignment);
+		c = &s->classes[class_index];
+		slab = cm__slab_partial_get(s, class_index);
+		if (slab == NULL)
+			return NULL;
 
-		if (!cm_scratch_memory_is_in_use(s, pt)) {
-			cm_allocation_header_fill(header, pt, cm_pointer_diff(header, pt));
-			s->alloc_point = cast(u8 *)pt;
-			ptr = data;
-		}
+		ptr = cm_pool_allocator_proc(&slab->pool, cmAllocation_Alloc, c->block_size, c->block_align, NULL, 0, flags);
+		slab->used++;
+		s->total_size += c->block_size;
+		if (slab->pool.free_list == NULL)
+			cm__slab_partial_unlink(c, slab);
+	} break;
 
-		if (flags & cmAllocatorFlag_ClearToZero)
-			cm_zero_size(ptr, size);
+	case cmAllocation_AllocBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize class_index, i = 0;
+		cmSlabClass *c;
+
+		// NOTE: Large blocks are left for cm_alloc_batch to forward one at a time
+		if (size > CM_SLAB_MAX_SIZE || alignment > CM__SLAB_MAX_ALIGN)
+			return NULL;
+
+		class_index = cm__slab_class_for(s, size, alignment);
+		c = &s->classes[class_index];
+		while (i < old_size) {
+			cmSlab *slab = cm__slab_partial_get(s, class_index);
+			if (slab == NULL)
+				return NULL;
+			while (i < old_size && slab->pool.free_list != NULL) {
+				ptrs[i++] = cm_pool_allocator_proc(&slab->pool, cmAllocation_Alloc, c->block_size, c->block_align, NULL, 0, flags);
+				slab->used++;
+				s->total_size += c->block_size;
+			}
+			if (slab->pool.free_list == NULL)
+				cm__slab_partial_unlink(c, slab);
+		}
+		ptr = ptrs;
 	} break;
 
 	case cmAllocation_Free: {
-		if (old_memory) {
-			void *end = cm_pointer_add(s->physical_start, s->total_size);
-			if (old_memory < s->physical_start || old_memory >= end) {
-				CM_ASSERT(false);
-			} else {
-				// NOTE(bill): Mark as free
-				cmAllocationHeader *h = cm_allocation_header(old_memory);
-				CM_ASSERT((h->size & CM_ISIZE_HIGH_BIT) == 0);
-				h->size = h->size | CM_ISIZE_HIGH_BIT;
+		cmSlab *slab;
+		cmSlabClass *c;
+		if (old_memory == NULL) return NULL;
 
-				while (s->free_point != s->alloc_point) {
-					cmAllocationHeader *header = cast(cmAllocationHeader *)s->free_point;
-					if ((header->size & CM_ISIZE_HIGH_BIT) == 0)
-						break;
+		slab = cm__slab_of(s, old_memory);
+		if (slab == NULL)
+			return s->backing.proc(s->backing.data, type, size, alignment, old_memory, old_size, flags);
+
+		c = &s->classes[slab->class_index];
+		cm_pool_allocator_proc(&slab->pool, cmAllocation_Free, 0, 0, old_memory, 0, flags);
+		slab->used--;
+		s->total_size -= c->block_size;
+
+		if (slab->used == 0) {
+			if (slab->in_partial)
+				cm__slab_partial_unlink(c, slab);
+			if (c->empty == NULL) c->empty = slab;
+			else                  cm__slab_release(s, slab);
+		} else if (!slab->in_partial) {
+			cm__slab_partial_link(c, slab);
+		}
+	} break;
 
-					s->free_point = cm_pointer_add(s->free_point, h->size & (~CM_ISIZE_HIGH_BIT));
-					if (s->free_point == end)
-						s->free_point = s->physical_start;
-				}
+	case cmAllocation_FreeBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i;
+		for (i = 0; i < old_size; i++)
+			cm_slab_allocator_proc(s, cmAllocation_Free, 0, 0, ptrs[i], 0, flags);
+		ptr = ptrs;
+	} break;
+
+	case cmAllocation_UsableSize: {
+		cmSlab *slab = cm__slab_of(s, old_memory);
+		if (slab == NULL)
+			return s->backing.proc(s->backing.data, type, size, alignment, old_memory, old_size, flags);
+		ptr = cast(u8 *)old_memory + s->classes[slab->class_index].block_size;
+	} break;
+
+	case cmAllocation_FreeAll: {
+		// NOTE: Allocations forwarded to the backing allocator are not tracked
+		isize i;
+		for (i = 0; i < s->slab_capacity; i++) {
+			if (s->slabs[i])
+				cm_vm_free(cm_virtual_memory(s->slabs[i], CM_SLAB_SIZE));
+		}
+		if (s->slabs)
+			cm_zero_size(s->slabs, s->slab_capacity * cm_size_of(cmSlab *));
+		s->slab_count = 0;
+		for (i = 0; i < CM_SLAB_CLASS_COUNT; i++) {
+			s->classes[i].partial = NULL;
+			s->classes[i].empty   = NULL;
+		}
+		s->total_size = 0;
+	} break;
+
+	case cmAllocation_Resize: {
+		cmSlab *slab = old_memory ? cm__slab_of(s, old_memory) : NULL;
+		if (slab) {
+			isize block_size = s->classes[slab->class_index].block_size;
+			if (size > 0 && size <= block_size && (size > block_size/2 || slab->class_index == 0) &&
+			    (cast(uintptr)old_memory & (alignment-1)) == 0)
+				return old_memory;
+		} else if (old_memory && (size > CM_SLAB_MAX_SIZE || alignment > CM__SLAB_MAX_ALIGN)) {
+			return s->backing.proc(s->backing.data, type, size, alignment, old_memory, old_size, flags);
+		}
+		ptr = cm_default_resize_align(cm_slab_allocator(s), old_memory, old_size, size, alignment);
+	} break;
+	}
+
+	return ptr;
+}
+
+
+//
+// NUMA Allocator
+//
+
+typedef struct cmNumaHeap {
+	cmAtomic32      lock;
+	b32             initialized;
+	cmSlabAllocator slab;
+} cmNumaHeap;
+
+cm_global cmNumaHeap cm__numa_heaps[CM_NUMA_MAX_NODES];
+
+// NOTE: Stored right before every pointer handed out
+typedef struct cmNumaHeader {
+	isize node;
+	isize offset; // NOTE: From the start of the slab block to the pointer
+} cmNumaHeader;
+
+typedef struct cmNumaMapHeader {
+	isize map_size;
+	isize offset;
+} cmNumaMapHeader;
+
+// NOTE: Backing of the node slab allocators, every allocation is a node bound mapping
+cm_internal CM_ALLOCATOR_PROC(cm__numa_vm_allocator_proc) {
+	isize node = cast(isize)cast(intptr)allocator_data;
+	void *ptr = NULL;
+	cm_unused(flags);
+
+	switch (type) {
+	case cmAllocation_Alloc: {
+		isize page_size = cm_virtual_memory_page_size(NULL);
+		isize map_size = cm_size_of(cmNumaMapHeader) + size + (alignment > page_size ? alignment : 0);
+		cmVirtualMemory vm;
+		cmNumaMapHeader *header;
+
+		map_size = (map_size + page_size - 1) & ~(page_size - 1);
+		vm = cm_vm_alloc_node(map_size, node);
+		if (vm.data == NULL)
+			return NULL;
+		ptr = cm_align_forward(cast(u8 *)vm.data + cm_size_of(cmNumaMapHeader), alignment);
+		header = cast(cmNumaMapHeader *)ptr - 1;
+		header->map_size = map_size;
+		header->offset   = cm_pointer_diff(vm.data, ptr);
+	} break;
+
+	case cmAllocation_Free: {
+		cmNumaMapHeader *header;
+		if (old_memory == NULL) break;
+		header = cast(cmNumaMapHeader *)old_memory - 1;
+		cm_vm_free(cm_virtual_memory(cast(u8 *)old_memory - header->offset, header->map_size));
+	} break;
+
+	case cmAllocation_FreeAll:
+		break;
+
+	case cmAllocation_Resize: {
+		cmAllocator a;
+		a.proc = cm__numa_vm_allocator_proc;
+		a.data = allocator_data;
+		ptr = cm_default_resize_align(a, old_memory, old_size, size, alignment);
+	} break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+cm_internal cmNumaHeap *
+cm__numa_heap_lock(isize node) {
+	cmNumaHeap *h = &cm__numa_heaps[node];
+	cm_atomic32_spin_lock(&h->lock, -1);
+	if (!h->initialized) {
+		cmAllocator backing;
+		backing.proc = cm__numa_vm_allocator_proc;
+		backing.data = cast(void *)cast(intptr)node;
+		cm_slab_init(&h->slab, backing);
+		h->slab.numa_node = node;
+		h->initialized = true;
+	}
+	return h;
+}
+
+cmAllocator
+cm_numa_allocator(isize node) {
+	cmAllocator allocator;
+	if (cm_numa_node_count() <= 1)
+		return cm_heap_allocator();
+	CM_ASSERT(node == CM_NUMA_CURRENT_NODE || (node >= 0 && node < cm_numa_node_count()));
+	allocator.proc = cm_numa_allocator_proc;
+	allocator.data = cast(void *)cast(intptr)node;
+	return allocator;
+}
+
+CM_ALLOCATOR_PROC(cm_numa_allocator_proc) {
+	isize node = cast(isize)cast(intptr)allocator_data;
+	void *ptr = NULL;
+
+	switch (type) {
+	case cmAllocation_Alloc: {
+		// NOTE: The header gets a full alignment step so the block keeps the alignment asked for
+		isize pad = CM_MAX(alignment, cm_size_of(cmNumaHeader));
+		cmNumaHeap *h;
+		void *block;
+		cmNumaHeader *header;
+
+		if (node == CM_NUMA_CURRENT_NODE)
+			node = cm_numa_current_node();
+		h = cm__numa_heap_lock(node);
+		block = cm_slab_allocator_proc(&h->slab, cmAllocation_Alloc, pad + size, alignment, NULL, 0, flags);
+		cm_atomic32_spin_unlock(&h->lock);
+		if (block == NULL)
+			return NULL;
+
+		ptr = cast(u8 *)block + pad;
+		header = cast(cmNumaHeader *)ptr - 1;
+		header->node   = node;
+		header->offset = pad;
+	} break;
+
+	case cmAllocation_Free: {
+		cmNumaHeader *header;
+		cmNumaHeap *h;
+		if (old_memory == NULL) break;
+
+		header = cast(cmNumaHeader *)old_memory - 1;
+		h = cm__numa_heap_lock(header->node);
+		cm_slab_allocator_proc(&h->slab, cmAllocation_Free, 0, 0, cast(u8 *)old_memory - header->offset, 0, flags);
+		cm_atomic32_spin_unlock(&h->lock);
+	} break;
+
+	case cmAllocation_FreeAll:
+		break;
+
+	case cmAllocation_Resize:
+		ptr = cm_default_resize_align(cm_numa_allocator(node), old_memory, old_size, size, alignment);
+		break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+cm_inline cmAllocationHeader *
+cm_allocation_header(void *data) {
+	isize *p = cast(isize *)data;
+	while (p[-1] == cast(isize)(-1)) {
+		p--;
+	}
+	return cast(cmAllocationHeader *)p - 1;
+}
+
+cm_inline void 
+cm_allocation_header_fill(cmAllocationHeader *header, void *data, isize size) {
+	isize *ptr;
+	header->size = size;
+	ptr = cast(isize *)(header + 1);
+	while (cast(void *)ptr < data) {
+		*ptr++ = cast(isize)(-1);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+//
+// Free List Allocator
+//
+
+cm_inline void 
+cm_free_list_init(cmFreeList *fl, void *start, isize size) {
+	CM_ASSERT(size > cm_size_of(cmFreeListBlock));
+
+	fl->physical_start   = start;
+	fl->total_size       = size;
+	fl->curr_block       = cast(cmFreeListBlock *)start;
+	fl->curr_block->size = size;
+	fl->curr_block->next = NULL;
+}
+
+cm_inline void 
+cm_free_list_init_from_allocator(cmFreeList *fl, cmAllocator backing, isize size) {
+	void *start = cm_alloc(backing, size);
+	cm_free_list_init(fl, start, size);
+}
+
+cm_inline cmAllocator 
+cm_free_list_allocator(cmFreeList *fl) {
+	cmAllocator a;
+	a.proc = cm_free_list_allocator_proc;
+	a.data = fl;
+	return a;
+}
+
+CM_ALLOCATOR_PROC(cm_free_list_allocator_proc) {
+	cmFreeList *fl = cast(cmFreeList *)allocator_data;
+	void *ptr = NULL;
+
+	CM_ASSERT_NOT_NULL(fl);
+
+	switch (type) {
+	case cmAllocation_Alloc: {
+		cmFreeListBlock *prev_block = NULL;
+		cmFreeListBlock *curr_block = fl->curr_block;
+
+		while (curr_block) {
+			isize total_size;
+			cmAllocationHeader *header;
+
+			total_size = size + alignment + cm_size_of(cmAllocationHeader);
+
+			if (curr_block->size < total_size) {
+				prev_block = curr_block;
+				curr_block = curr_block->next;
+				continue;
+			}
+
+			if (curr_block->size - total_size <= cm_size_of(cmAllocationHeader)) {
+				total_size = curr_block->size;
+
+				if (prev_block)
+					prev_block->next = curr_block->next;
+				else
+					fl->curr_block = curr_block->next;
+			} else {
+				// NOTE(bill): Create a new block for the remaining memory
+				cmFreeListBlock *next_block;
+				next_block = cast(cmFreeListBlock *)cm_pointer_add(curr_block, total_size);
+
+				CM_ASSERT(cast(void *)next_block < cm_pointer_add(fl->physical_start, fl->total_size));
+
+				next_block->size = curr_block->size - total_size;
+				next_block->next = curr_block->next;
+
+				if (prev_block)
+					prev_block->next = next_block;
+				else
+					fl->curr_block = next_block;
 			}
+
+
+			// TODO(bill): Set Header Info
+			header = cast(cmAllocationHeader *)curr_block;
+			ptr = cm_align_forward(header+1, alignment);
+			cm_allocation_header_fill(header, ptr, size);
+
+			fl->total_allocated += total_size;
+			fl->allocation_count++;
+
+
+			if (flags & cmAllocatorFlag_ClearToZero)
+				cm_zero_size(ptr, size);
+			return ptr;
+		}
+		// NOTE(bill): if ptr == NULL, ran out of free list memory! FUCK!
+		return NULL;
+	} break;
+
+	case cmAllocation_Free: {
+		cmAllocationHeader *header = cm_allocation_header(old_memory);
+		isize block_size = header->size;
+		uintptr block_start, block_end;
+		cmFreeListBlock *prev_block = NULL;
+		cmFreeListBlock *curr_block = fl->curr_block;
+
+		block_start = cast(uintptr)header;
+		block_end   = cast(uintptr)block_start + block_size;
+
+		while (curr_block) {
+			if (cast(uintptr)curr_block >= block_end)
+				break;
+			prev_block = curr_block;
+			curr_block = curr_block->next;
+		}
+
+		if (prev_block == NULL) {
+			prev_block = cast(cmFreeListBlock *)block_start;
+			prev_block->size = block_size;
+			prev_block->next = fl->curr_block;
+
+			fl->curr_block = prev_block;
+		} else if ((cast(uintptr)prev_block + prev_block->size) == block_start) {
+			prev_block->size += block_size;
+		} else {
+			cmFreeListBlock *tmp = cast(cmFreeListBlock *)block_start;
+			tmp->size = block_size;
+			tmp->next = prev_block->next;
+			prev_block->next = tmp;
+
+			prev_block = tmp;
+		}
+
+		if (curr_block && (cast(uintptr)curr_block == block_end)) {
+			prev_block->size += curr_block->size;
+			prev_block->next = curr_block->next;
 		}
+
+		fl->allocation_count--;
+		fl->total_allocated -= block_size;
 	} break;
 
 	case cmAllocation_FreeAll:
-		s->alloc_point = s->physical_start;
-		s->free_point  = s->physical_start;
+		cm_free_list_init(fl, fl->physical_start, fl->total_size);
 		break;
 
 	case cmAllocation_Resize:
-		ptr = cm_default_resize_align(cm_scratch_allocator(s), old_memory, old_size, size, alignment);
+		ptr = cm_default_resize_align(cm_free_list_allocator(fl), old_memory, old_size, size, alignment);
 		break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+///////////////////////////////////////////////////////////////////////
+//
+// Fixed Heap Allocator (TLSF)
+//
+
+#define CM__FIXED_HEAP_HEADER   cm_offset_of(cmFixedHeapBlock, next_free)
+#define CM__FIXED_HEAP_ALIGN    (cast(isize)1 << CM_FIXED_HEAP_ALIGN_LOG2)
+#define CM__FIXED_HEAP_MIN_SIZE CM__FIXED_HEAP_ALIGN // NOTE: Room for the two free list links
+#define CM__FIXED_HEAP_SMALL    (cast(isize)1 << CM_FIXED_HEAP_FL_SHIFT)
+#define CM__FIXED_HEAP_MAX_SIZE (cast(isize)1 << CM_FIXED_HEAP_FL_MAX)
+
+cm_inline isize
+cm__fixed_heap_block_size(cmFixedHeapBlock *b) { return b->size & ~cast(isize)1; }
+
+cm_inline b32
+cm__fixed_heap_block_is_free(cmFixedHeapBlock *b) { return cast(b32)(b->size & 1); }
+
+cm_inline cmFixedHeapBlock *
+cm__fixed_heap_block_next(cmFixedHeapBlock *b) {
+	return cast(cmFixedHeapBlock *)(cast(u8 *)b + CM__FIXED_HEAP_HEADER + cm__fixed_heap_block_size(b));
+}
+
+cm_inline isize
+cm__fixed_heap_adjust_size(isize size) {
+	size = (size + CM__FIXED_HEAP_ALIGN - 1) & ~(CM__FIXED_HEAP_ALIGN - 1);
+	return CM_MAX(size, CM__FIXED_HEAP_MIN_SIZE);
+}
+
+cm_internal void
+cm__fixed_heap_mapping(isize size, isize *fl, isize *sl) {
+	if (size < CM__FIXED_HEAP_SMALL) {
+		*fl = 0;
+		*sl = size >> CM_FIXED_HEAP_ALIGN_LOG2;
+	} else {
+		isize f = cm__bit_msb(cast(u64)size);
+		*sl = (size >> (f - CM_FIXED_HEAP_SL_LOG2)) ^ CM_FIXED_HEAP_SL_COUNT;
+		*fl = f - (CM_FIXED_HEAP_FL_SHIFT - 1);
+	}
+}
+
+cm_internal void
+cm__fixed_heap_insert(cmFixedHeap *h, cmFixedHeapBlock *b) {
+	isize fl, sl;
+	cmFixedHeapBlock *head;
+	cm__fixed_heap_mapping(cm__fixed_heap_block_size(b), &fl, &sl);
+	head = h->blocks[fl][sl];
+	b->next_free = head;
+	b->prev_free = NULL;
+	if (head)
+		head->prev_free = b;
+	h->blocks[fl][sl] = b;
+	h->fl_bitmap     |= 1u << fl;
+	h->sl_bitmap[fl] |= 1u << sl;
+}
+
+cm_internal void
+cm__fixed_heap_remove(cmFixedHeap *h, cmFixedHeapBlock *b) {
+	isize fl, sl;
+	cm__fixed_heap_mapping(cm__fixed_heap_block_size(b), &fl, &sl);
+	if (b->prev_free)
+		b->prev_free->next_free = b->next_free;
+	else
+		h->blocks[fl][sl] = b->next_free;
+	if (b->next_free)
+		b->next_free->prev_free = b->prev_free;
+
+	if (h->blocks[fl][sl] == NULL) {
+		h->sl_bitmap[fl] &= ~(1u << sl);
+		if (h->sl_bitmap[fl] == 0)
+			h->fl_bitmap &= ~(1u << fl);
+	}
+}
+
+// NOTE: Finds a free block of at least `size` bytes in the smallest class that is
+// guaranteed to fit, so the first block of the list can always be taken
+cm_internal cmFixedHeapBlock *
+cm__fixed_heap_find(cmFixedHeap *h, isize size) {
+	isize fl, sl;
+	u32 sl_map;
+
+	if (size >= CM__FIXED_HEAP_SMALL)
+		size += (cast(isize)1 << (cm__bit_msb(cast(u64)size) - CM_FIXED_HEAP_SL_LOG2)) - 1;
+	if (size >= CM__FIXED_HEAP_MAX_SIZE)
+		return NULL;
+	cm__fixed_heap_mapping(size, &fl, &sl);
+
+	sl_map = h->sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0) {
+		u32 fl_map = fl+1 < 32 ? h->fl_bitmap & (~0u << (fl+1)) : 0;
+		if (fl_map == 0)
+			return NULL;
+		fl = cm__bit_lsb(fl_map);
+		sl_map = h->sl_bitmap[fl];
+	}
+	sl = cm__bit_lsb(sl_map);
+	return h->blocks[fl][sl];
+}
+
+// NOTE: Merges a free block with the free blocks on either side of it
+cm_internal cmFixedHeapBlock *
+cm__fixed_heap_merge(cmFixedHeap *h, cmFixedHeapBlock *b) {
+	cmFixedHeapBlock *prev = b->prev_phys;
+	cmFixedHeapBlock *next = cm__fixed_heap_block_next(b);
+
+	if (prev && cm__fixed_heap_block_is_free(prev)) {
+		cm__fixed_heap_remove(h, prev);
+		prev->size = (cm__fixed_heap_block_size(prev) + CM__FIXED_HEAP_HEADER + cm__fixed_heap_block_size(b)) | 1;
+		b = prev;
+		next->prev_phys = b;
+	}
+	if (cm__fixed_heap_block_is_free(next)) {
+		cm__fixed_heap_remove(h, next);
+		b->size = (cm__fixed_heap_block_size(b) + CM__FIXED_HEAP_HEADER + cm__fixed_heap_block_size(next)) | 1;
+		cm__fixed_heap_block_next(b)->prev_phys = b;
+	}
+	return b;
+}
+
+// NOTE: Gives everything past `size` bytes of a used block back to the heap
+cm_internal void
+cm__fixed_heap_trim(cmFixedHeap *h, cmFixedHeapBlock *b, isize size) {
+	isize block_size = cm__fixed_heap_block_size(b);
+	cmFixedHeapBlock *rest;
+
+	if (block_size < size + CM__FIXED_HEAP_HEADER + CM__FIXED_HEAP_MIN_SIZE)
+		return;
+
+	rest = cast(cmFixedHeapBlock *)(cast(u8 *)b + CM__FIXED_HEAP_HEADER + size);
+	rest->prev_phys = b;
+	rest->size = (block_size - size - CM__FIXED_HEAP_HEADER) | 1;
+	b->size = size;
+	cm__fixed_heap_block_next(rest)->prev_phys = rest;
+	cm__fixed_heap_insert(h, cm__fixed_heap_merge(h, rest));
+}
+
+// NOTE: Lays out a single free block over the region, keeping `backing`
+cm_internal void 
+cm__fixed_heap_reset(cmFixedHeap *h, void *start, isize size) {
+	cmAllocator backing = h->backing;
+	cmFixedHeapBlock *first, *sentinel;
+	isize usable;
+
+	cm_zero_item(h);
+	h->backing        = backing;
+	h->physical_start = start;
+	h->total_size     = size;
+
+	first  = cast(cmFixedHeapBlock *)cm_pointer_sub(cm_align_forward(cm_pointer_add(start, CM__FIXED_HEAP_HEADER), CM__FIXED_HEAP_ALIGN),
+	                                                 CM__FIXED_HEAP_HEADER);
+	usable = cm_pointer_diff(first, cm_pointer_add(start, size)) - 2*CM__FIXED_HEAP_HEADER;
+	usable &= ~(CM__FIXED_HEAP_ALIGN - 1);
+	usable = CM_MIN(usable, CM__FIXED_HEAP_MAX_SIZE - CM__FIXED_HEAP_ALIGN);
+	CM_ASSERT_MSG(usable >= CM__FIXED_HEAP_MIN_SIZE, "Fixed heap region is too small: %td", size);
+
+	first->prev_phys = NULL;
+	first->size      = usable | 1;
+
+	// NOTE: A zero sized used block at the end stops merging past the region
+	sentinel = cm__fixed_heap_block_next(first);
+	sentinel->prev_phys = first;
+	sentinel->size      = 0;
+
+	cm__fixed_heap_insert(h, first);
+}
+
+void 
+cm_fixed_heap_init(cmFixedHeap *h, void *start, isize size) {
+	h->backing.proc = NULL;
+	h->backing.data = NULL;
+	cm__fixed_heap_reset(h, start, size);
+}
+
+cm_inline void 
+cm_fixed_heap_init_from_allocator(cmFixedHeap *h, cmAllocator backing, isize size) {
+	h->backing = backing;
+	cm__fixed_heap_reset(h, cm_alloc(backing, size), size);
+}
+
+cm_inline void 
+cm_fixed_heap_free(cmFixedHeap *h) {
+	if (h->backing.proc) {
+		cm_free(h->backing, h->physical_start);
+		h->physical_start = NULL;
+	}
+}
+
+cm_inline cmAllocator 
+cm_fixed_heap_allocator(cmFixedHeap *h) {
+	cmAllocator a;
+	a.proc = cm_fixed_heap_allocator_proc;
+	a.data = h;
+	return a;
+}
+
+cm_internal void *
+cm__fixed_heap_alloc(cmFixedHeap *h, isize size, isize alignment) {
+	isize adjust = cm__fixed_heap_adjust_size(size);
+	isize search = adjust;
+	cmFixedHeapBlock *b;
+
+	CM_ASSERT(cm_is_power_of_two(alignment));
+	if (alignment > CM__FIXED_HEAP_ALIGN)
+		search += alignment + CM__FIXED_HEAP_HEADER + CM__FIXED_HEAP_MIN_SIZE;
+
+	b = cm__fixed_heap_find(h, search);
+	if (b == NULL)
+		return NULL;
+	cm__fixed_heap_remove(h, b);
+	b->size &= ~cast(isize)1;
+
+	if (alignment > CM__FIXED_HEAP_ALIGN) {
+		u8 *data    = cast(u8 *)b + CM__FIXED_HEAP_HEADER;
+		u8 *aligned = cast(u8 *)cm_align_forward(data, alignment);
+		isize gap   = aligned - data;
+		if (gap > 0 && gap < CM__FIXED_HEAP_HEADER + CM__FIXED_HEAP_MIN_SIZE) {
+			aligned = cast(u8 *)cm_align_forward(data + CM__FIXED_HEAP_HEADER + CM__FIXED_HEAP_MIN_SIZE, alignment);
+			gap = aligned - data;
+		}
+		if (gap > 0) {
+			// NOTE: Split off the leading gap as its own free block
+			cmFixedHeapBlock *ab = cast(cmFixedHeapBlock *)(aligned - CM__FIXED_HEAP_HEADER);
+			ab->prev_phys = b;
+			ab->size = cm__fixed_heap_block_size(b) - gap;
+			cm__fixed_heap_block_next(ab)->prev_phys = ab;
+			b->size = (gap - CM__FIXED_HEAP_HEADER) | 1;
+			cm__fixed_heap_insert(h, b);
+			b = ab;
+		}
+	}
+
+	cm__fixed_heap_trim(h, b, adjust);
+	h->total_allocated += cm__fixed_heap_block_size(b);
+	h->allocation_count++;
+	return cast(u8 *)b + CM__FIXED_HEAP_HEADER;
+}
+
+cm_internal void
+cm__fixed_heap_release(cmFixedHeap *h, void *ptr) {
+	cmFixedHeapBlock *b = cast(cmFixedHeapBlock *)cm_pointer_sub(ptr, CM__FIXED_HEAP_HEADER);
+	CM_ASSERT_MSG(!cm__fixed_heap_block_is_free(b), "Double free in fixed heap");
+	h->total_allocated -= cm__fixed_heap_block_size(b);
+	h->allocation_count--;
+	b->size |= 1;
+	cm__fixed_heap_insert(h, cm__fixed_heap_merge(h, b));
+}
+
+CM_ALLOCATOR_PROC(cm_fixed_heap_allocator_proc) {
+	cmFixedHeap *h = cast(cmFixedHeap *)allocator_data;
+	void *ptr = NULL;
+
+	CM_ASSERT_NOT_NULL(h);
+	cm_unused(old_size);
+
+	switch (type) {
+	case cmAllocation_Alloc:
+		ptr = cm__fixed_heap_alloc(h, size, alignment);
+		if (ptr && (flags & cmAllocatorFlag_ClearToZero))
+			cm_zero_size(ptr, size);
+		break;
+
+	case cmAllocation_Free:
+		if (old_memory)
+			cm__fixed_heap_release(h, old_memory);
+		break;
+
+	case cmAllocation_FreeAll:
+		cm__fixed_heap_reset(h, h->physical_start, h->total_size);
+		break;
+
+	case cmAllocation_Resize: {
+		cmFixedHeapBlock *b, *next;
+		isize adjust, curr;
+
+		if (old_memory == NULL) {
+			ptr = cm__fixed_heap_alloc(h, size, alignment);
+			break;
+		}
+		if (size == 0) {
+			cm__fixed_heap_release(h, old_memory);
+			break;
+		}
+
+		b      = cast(cmFixedHeapBlock *)cm_pointer_sub(old_memory, CM__FIXED_HEAP_HEADER);
+		adjust = cm__fixed_heap_adjust_size(size);
+		curr   = cm__fixed_heap_block_size(b);
+		next   = cm__fixed_heap_block_next(b);
+
+		if ((cast(uintptr)old_memory & (alignment-1)) == 0) {
+			// NOTE: Grow into the next block if it is free and big enough
+			if (adjust > curr && cm__fixed_heap_block_is_free(next) &&
+			    curr + CM__FIXED_HEAP_HEADER + cm__fixed_heap_block_size(next) >= adjust) {
+				cm__fixed_heap_remove(h, next);
+				b->size = curr + CM__FIXED_HEAP_HEADER + cm__fixed_heap_block_size(next);
+				cm__fixed_heap_block_next(b)->prev_phys = b;
+			}
+			if (adjust <= cm__fixed_heap_block_size(b)) {
+				cm__fixed_heap_trim(h, b, adjust);
+				h->total_allocated += cm__fixed_heap_block_size(b) - curr;
+				ptr = old_memory;
+				break;
+			}
+		}
+
+		ptr = cm__fixed_heap_alloc(h, size, alignment);
+		if (ptr == NULL)
+			break;
+		cm_memcopy(ptr, old_memory, CM_MIN(curr, size));
+		cm__fixed_heap_release(h, old_memory);
+	} break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+void 
+cm_scratch_memory_init(cmScratchMemory *s, void *start, isize size) {
+	s->physical_start = start;
+	s->total_size     = size;
+	s->alloc_point    = start;
+	s->free_point     = start;
+}
+
+b32 
+cm_scratch_memory_is_in_use(cmScratchMemory *s, void *ptr) {
+	if (s->free_point == s->alloc_point) return false;
+	if (s->alloc_point > s->free_point)
+		return ptr >= s->free_point && ptr < s->alloc_point;
+	return ptr >= s->free_point || ptr < s->alloc_point;
+}
+
+cmAllocator 
+cm_scratch_allocator(cmScratchMemory *s) {
+	cmAllocator a;
+	a.proc = cm_scratch_allocator_proc;
+	a.data = s;
+	return a;
+}
+
+CM_ALLOCATOR_PROC(cm_scratch_allocator_proc) {
+	cmScratchMemory *s = cast(cmScratchMemory *)allocator_data;
+	void *ptr = NULL;
+	CM_ASSERT_NOT_NULL(s);
+
+	switch (type) {
+	case cmAllocation_Alloc: {
+		void *pt = s->alloc_point;
+		cmAllocationHeader *header = cast(cmAllocationHeader *)pt;
+		void *data = cm_align_forward(header+1, alignment);
+		void *end = cm_pointer_add(s->physical_start, s->total_size);
+
+		CM_ASSERT(alignment % 4 == 0);
+		size = ((size + 3)/4)*4;
+		pt = cm_pointer_add(pt, size);
+
+		// NOTE(bill): Wrap around
+		if (pt > end) {
+			header->size = cm_pointer_diff(header, end) | CM_ISIZE_HIGH_BIT;
+			pt = s->physical_start;
+			header = cast(cmAllocationHeader *)pt;
+			data = cm_align_forward(header+1, alignment);
+			pt = cm_pointer_add(pt, size);
+		}
+
+		if (!cm_scratch_memory_is_in_use(s, pt)) {
+			cm_allocation_header_fill(header, pt, cm_pointer_diff(header, pt));
+			s->alloc_point = cast(u8 *)pt;
+			ptr = data;
+		}
+
+		if (flags & cmAllocatorFlag_ClearToZero)
+			cm_zero_size(ptr, size);
+	} break;
+
+	case cmAllocation_Free: {
+		if (old_memory) {
+			void *end = cm_pointer_add(s->physical_start, s->total_size);
+			if (old_memory < s->physical_start || old_memory >= end) {
+				CM_ASSERT(false);
+			} else {
+				// NOTE(bill): Mark as free
+				cmAllocationHeader *h = cm_allocation_header(old_memory);
+				CM_ASSERT((h->size & CM_ISIZE_HIGH_BIT) == 0);
+				h->size = h->size | CM_ISIZE_HIGH_BIT;
+
+				while (s->free_point != s->alloc_point) {
+					cmAllocationHeader *header = cast(cmAllocationHeader *)s->free_point;
+					if ((header->size & CM_ISIZE_HIGH_BIT) == 0)
+						break;
+
+					s->free_point = cm_pointer_add(s->free_point, h->size & (~CM_ISIZE_HIGH_BIT));
+					if (s->free_point == end)
+						s->free_point = s->physical_start;
+				}
+			}
+		}
+	} break;
+
+	case cmAllocation_FreeAll:
+		s->alloc_point = s->physical_start;
+		s->free_point  = s->physical_start;
+		break;
+
+	case cmAllocation_Resize:
+		ptr = cm_default_resize_align(cm_scratch_allocator(s), old_memory, old_size, size, alignment);
+		break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+
+///////////////////////////////////////////////////////////////////////
+//
+// Thread Scratch Arenas
+//
+
+CM_STATIC_ASSERT(CM_SCRATCH_ARENA_COUNT >= 2);
+
+cm_global cm_thread_local cmArena cm__scratch_arenas[CM_SCRATCH_ARENA_COUNT];
+
+cm_internal void
+cm__scratch_free(cmArena *arenas) {
+	isize i;
+	for (i = 0; i < CM_SCRATCH_ARENA_COUNT; i++)
+		cm_arena_free(&arenas[i]);
+}
+
+#if defined(CM_SYS_WINDOWS)
+// NOTE: Fiber local storage is the only thread exit callback Windows has without DllMain
+cm_global DWORD     cm__scratch_fls_index;
+cm_global INIT_ONCE cm__scratch_fls_once = INIT_ONCE_STATIC_INIT;
+
+cm_internal void NTAPI
+cm__scratch_destructor(void *arenas) {
+	cm__scratch_free(cast(cmArena *)arenas);
+}
+
+cm_internal BOOL CALLBACK
+cm__scratch_fls_init(INIT_ONCE *once, void *parameter, void **context) {
+	cm_unused(once);
+	cm_unused(parameter);
+	cm_unused(context);
+	cm__scratch_fls_index = FlsAlloc(cm__scratch_destructor);
+	return cm__scratch_fls_index != FLS_OUT_OF_INDEXES;
+}
+#else
+cm_global pthread_key_t  cm__scratch_key;
+cm_global pthread_once_t cm__scratch_key_once = PTHREAD_ONCE_INIT;
+
+cm_internal void
+cm__scratch_destructor(void *arenas) {
+	cm__scratch_free(cast(cmArena *)arenas);
+}
+
+cm_internal void
+cm__scratch_key_init(void) {
+	pthread_key_create(&cm__scratch_key, cm__scratch_destructor);
+}
+#endif
+
+cmTempArenaMemory
+cm_scratch_begin(cmArena **conflicts, isize conflict_count) {
+	cmArena *arena = NULL;
+	isize i, j;
+
+	for (i = 0; i < CM_SCRATCH_ARENA_COUNT && arena == NULL; i++) {
+		arena = &cm__scratch_arenas[i];
+		for (j = 0; j < conflict_count; j++) {
+			if (conflicts[j] == arena) {
+				arena = NULL;
+				break;
+			}
+		}
+	}
+	CM_ASSERT_MSG(arena != NULL, "Every scratch arena conflicts, raise CM_SCRATCH_ARENA_COUNT");
+
+	if (arena->physical_start == NULL) {
+		b32 ok = cm_arena_init_virtual(arena, CM_SCRATCH_ARENA_RESERVE, CM_SCRATCH_ARENA_HIGH_WATER_MARK);
+		CM_ASSERT_MSG(ok, "Could not reserve a scratch arena");
+		cm_unused(ok);
+	#if defined(CM_SYS_WINDOWS)
+		if (InitOnceExecuteOnce(&cm__scratch_fls_once, cm__scratch_fls_init, NULL, NULL))
+			FlsSetValue(cm__scratch_fls_index, cm__scratch_arenas);
+	#else
+		pthread_once(&cm__scratch_key_once, cm__scratch_key_init);
+		pthread_setspecific(cm__scratch_key, cm__scratch_arenas);
+	#endif
+	}
+
+	return cm_temp_arena_memory_begin(arena);
+}
+
+void
+cm_scratch_end(cmTempArenaMemory scratch) {
+	cm_temp_arena_memory_end(scratch);
+	if (scratch.arena->temp_count == 0)
+		cm_free_all(cm_arena_allocator(scratch.arena));
+}
+
+
+///////////////////////////////////////////////////////////////////////
+//
+// Stack Allocator
+//
+
+void
+cm_stack_init_from_memory(cmStackAllocator *s, void *start, isize size) {
+	cm_zero_item(s);
+	s->physical_start = start;
+	s->total_size     = size;
+}
+
+void
+cm_stack_init_from_allocator(cmStackAllocator *s, cmAllocator backing, isize size) {
+	cm_zero_item(s);
+	s->backing        = backing;
+	s->physical_start = cm_alloc(backing, size);
+	s->total_size     = s->physical_start ? size : 0;
+}
+
+void
+cm_stack_free(cmStackAllocator *s) {
+	if (s->backing.proc) {
+		cm_free(s->backing, s->physical_start);
+		s->physical_start = NULL;
+	}
+	s->total_size = 0;
+	s->offset     = 0;
+	s->top        = NULL;
+}
+
+cm_inline cmStackMarker
+cm_stack_marker(cmStackAllocator *s) {
+	cmStackMarker marker;
+	marker.stack  = s;
+	marker.offset = s->offset;
+	marker.top    = s->top;
+	return marker;
+}
+
+cm_inline void
+cm_stack_rewind(cmStackMarker marker) {
+	CM_ASSERT(marker.offset <= marker.stack->offset);
+	marker.stack->offset = marker.offset;
+	marker.stack->top    = marker.top;
+}
+
+cmAllocator
+cm_stack_allocator(cmStackAllocator *s) {
+	cmAllocator a;
+	a.proc = cm_stack_allocator_proc;
+	a.data = s;
+	return a;
+}
+
+cm_internal void
+cm__stack_pop(cmStackAllocator *s) {
+	// NOTE: Pop the top block and every block below it that was already freed
+	while (s->top) {
+		cmStackHeader *header = cast(cmStackHeader *)s->top - 1;
+		s->offset = header->prev_offset & ~CM_ISIZE_HIGH_BIT;
+		s->top    = header->prev_top;
+		if (s->top == NULL || ((cast(cmStackHeader *)s->top - 1)->prev_offset & CM_ISIZE_HIGH_BIT) == 0)
+			break;
+	}
+}
+
+CM_ALLOCATOR_PROC(cm_stack_allocator_proc) {
+	cmStackAllocator *s = cast(cmStackAllocator *)allocator_data;
+	void *ptr = NULL;
+	CM_ASSERT_NOT_NULL(s);
+
+	switch (type) {
+	case cmAllocation_Alloc: {
+		u8 *start = cast(u8 *)s->physical_start;
+		u8 *data  = cast(u8 *)cm_align_forward(start + s->offset + cm_size_of(cmStackHeader), alignment);
+		cmStackHeader *header;
+
+		if (data + size > start + s->total_size) {
+			CM_ASSERT_MSG(false, "Stack allocator is out of memory");
+			return NULL;
+		}
+
+		header = cast(cmStackHeader *)data - 1;
+		header->prev_offset = s->offset;
+		header->prev_top    = s->top;
+		s->offset = cm_pointer_diff(start, data + size);
+		s->top    = data;
+		ptr = data;
+
+		if (flags & cmAllocatorFlag_ClearToZero)
+			cm_zero_size(ptr, size);
+	} break;
+
+	case cmAllocation_Free: {
+		cmStackHeader *header;
+		if (old_memory == NULL) return NULL;
+
+		CM_ASSERT(old_memory > s->physical_start && cm_pointer_diff(s->physical_start, old_memory) <= s->offset);
+		if (old_memory == s->top) {
+			cm__stack_pop(s);
+		} else {
+			header = cast(cmStackHeader *)old_memory - 1;
+			CM_ASSERT_MSG((header->prev_offset & CM_ISIZE_HIGH_BIT) == 0, "Double free in stack allocator");
+			header->prev_offset |= CM_ISIZE_HIGH_BIT;
+		}
+	} break;
+
+	case cmAllocation_FreeAll:
+		s->offset = 0;
+		s->top    = NULL;
+		break;
+
+	case cmAllocation_Resize:
+		if (old_memory != NULL && old_memory == s->top && size > 0 && (cast(uintptr)old_memory & (alignment-1)) == 0) {
+			// NOTE: The top block can simply move its end
+			isize end = cm_pointer_diff(s->physical_start, old_memory) + size;
+			if (end <= s->total_size) {
+				s->offset = end;
+				if (size > old_size && (flags & cmAllocatorFlag_ClearToZero))
+					cm_zero_size(cm_pointer_add(old_memory, old_size), size - old_size);
+				return old_memory;
+			}
+		}
+		ptr = cm_default_resize_align(cm_stack_allocator(s), old_memory, old_size, size, alignment);
+		break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+
+///////////////////////////////////////////////////////////////////////
+//
+// Tracking Allocator
+//
+
+cm_global cm_thread_local char const *cm__tracking_site_file;
+cm_global cm_thread_local i32         cm__tracking_site_line;
+
+cm_inline void *
+cm_alloc_align_at(cmAllocator a, isize size, isize alignment, char const *file, i32 line) {
+	char const *prev_file = cm__tracking_site_file;
+	i32         prev_line = cm__tracking_site_line;
+	void *ptr;
+	cm__tracking_site_file = file;
+	cm__tracking_site_line = line;
+	ptr = cm_alloc_align(a, size, alignment);
+	cm__tracking_site_file = prev_file;
+	cm__tracking_site_line = prev_line;
+	return ptr;
+}
+
+cm_inline void *
+cm_alloc_at(cmAllocator a, isize size, char const *file, i32 line) {
+	return cm_alloc_align_at(a, size, CM_DEFAULT_MEMORY_ALIGNMENT, file, line);
+}
+
+cm_inline void *
+cm_resize_align_at(cmAllocator a, void *ptr, isize old_size, isize new_size, isize alignment, char const *file, i32 line) {
+	char const *prev_file = cm__tracking_site_file;
+	i32         prev_line = cm__tracking_site_line;
+	void *result;
+	cm__tracking_site_file = file;
+	cm__tracking_site_line = line;
+	result = cm_resize_align(a, ptr, old_size, new_size, alignment);
+	cm__tracking_site_file = prev_file;
+	cm__tracking_site_line = prev_line;
+	return result;
+}
+
+cm_inline void *
+cm_resize_at(cmAllocator a, void *ptr, isize old_size, isize new_size, char const *file, i32 line) {
+	return cm_resize_align_at(a, ptr, old_size, new_size, CM_DEFAULT_MEMORY_ALIGNMENT, file, line);
+}
+
+cm_internal isize
+cm__tracking_site_slot(cmTrackingAllocator *t, char const *file, i32 line) {
+	u64 key = cast(u64)cast(uintptr)file ^ (cast(u64)line << 40);
+	return cast(isize)((key * 0x9E3779B97F4A7C15ull) >> 32) & (t->site_table_capacity - 1);
+}
+
+// NOTE: Must be called with the lock held, -1 if the site could not be recorded
+cm_internal i32
+cm__tracking_site_get(cmTrackingAllocator *t, char const *file, i32 line) {
+	isize slot;
+	cmTrackingSite *site;
+
+	if (file == NULL)
+		return -1;
+
+	if (t->site_table_capacity > 0) {
+		for (slot = cm__tracking_site_slot(t, file, line); t->site_table[slot] >= 0; slot = (slot+1) & (t->site_table_capacity-1)) {
+			site = &t->sites[t->site_table[slot]];
+			if (site->file == file && site->line == line)
+				return t->site_table[slot];
+		}
+	}
+
+	if (t->site_count == t->site_capacity) {
+		isize new_capacity = CM_MAX(2*t->site_capacity, 64);
+		cmTrackingSite *sites = cast(cmTrackingSite *)cm_resize(cm_heap_allocator(), t->sites,
+		                                                        t->site_capacity * cm_size_of(cmTrackingSite),
+		                                                        new_capacity * cm_size_of(cmTrackingSite));
+		if (sites == NULL)
+			return -1;
+		t->sites = sites;
+		t->site_capacity = new_capacity;
+	}
+
+	if (2*(t->site_count+1) > t->site_table_capacity) {
+		isize new_capacity = CM_MAX(2*t->site_table_capacity, 128), i;
+		i32 *table = cast(i32 *)cm_alloc(cm_heap_allocator(), new_capacity * cm_size_of(i32));
+		if (table == NULL)
+			return -1;
+		if (t->site_table)
+			cm_free(cm_heap_allocator(), t->site_table);
+		t->site_table = table;
+		t->site_table_capacity = new_capacity;
+		cm_memset(table, 0xff, new_capacity * cm_size_of(i32));
+		for (i = 0; i < t->site_count; i++) {
+			slot = cm__tracking_site_slot(t, t->sites[i].file, t->sites[i].line);
+			while (table[slot] >= 0)
+				slot = (slot+1) & (new_capacity-1);
+			table[slot] = cast(i32)i;
+		}
+	}
+
+	slot = cm__tracking_site_slot(t, file, line);
+	while (t->site_table[slot] >= 0)
+		slot = (slot+1) & (t->site_table_capacity-1);
+	t->site_table[slot] = cast(i32)t->site_count;
+
+	site = &t->sites[t->site_count];
+	cm_zero_item(site);
+	site->file = file;
+	site->line = line;
+	return cast(i32)t->site_count++;
+}
+
+cm_internal void
+cm__tracking_lock(cmTrackingAllocator *t) {
+	cm_atomic32_spin_lock(&t->lock, -1);
+}
+
+cm_internal void
+cm__tracking_unlock(cmTrackingAllocator *t) {
+	cm_mfence();
+	cm_atomic32_spin_unlock(&t->lock);
+}
+
+// NOTE: Must be called with the lock held
+cm_internal void
+cm__tracking_add(cmTrackingAllocator *t, i32 site_index, isize size, isize count) {
+	t->live_bytes += size;
+	t->live_count += count;
+	if (t->live_bytes > t->peak_bytes)
+		t->peak_bytes = t->live_bytes;
+	if (size > 0) {
+		t->total_bytes += size;
+	}
+	if (site_index >= 0) {
+		cmTrackingSite *site = &t->sites[site_index];
+		site->live_bytes += size;
+		site->live_count += count;
+		if (site->live_bytes > site->peak_bytes)
+			site->peak_bytes = site->live_bytes;
+		if (size > 0)
+			site->total_bytes += size;
+	}
+}
+
+void
+cm_tracking_init(cmTrackingAllocator *t, cmAllocator backing) {
+	cm_zero_item(t);
+	t->backing = backing;
+}
+
+void
+cm_tracking_free(cmTrackingAllocator *t) {
+	if (t->sites)
+		cm_free(cm_heap_allocator(), t->sites);
+	if (t->site_table)
+		cm_free(cm_heap_allocator(), t->site_table);
+	cm_tracking_init(t, t->backing);
+}
+
+cm_inline cmAllocator
+cm_tracking_allocator(cmTrackingAllocator *t) {
+	cmAllocator allocator;
+	allocator.proc = cm_tracking_allocator_proc;
+	allocator.data = t;
+	return allocator;
+}
+
+CM_ALLOCATOR_PROC(cm_tracking_allocator_proc) {
+	cmTrackingAllocator *t = cast(cmTrackingAllocator *)allocator_data;
+	cmTrackingHeader *header;
+	isize header_align = CM_MAX(alignment, cm_size_of(isize));
+	isize pad = (cm_size_of(cmTrackingHeader) + header_align - 1) & ~(header_align - 1);
+	void *ptr = NULL;
+	u8 *raw;
+
+	switch (type) {
+	case cmAllocation_Alloc: {
+		isize bin;
+		raw = cast(u8 *)t->backing.proc(t->backing.data, type, size + pad, header_align, NULL, 0, flags);
+		if (raw == NULL)
+			return NULL;
+		ptr = raw + pad;
+		header = cast(cmTrackingHeader *)ptr - 1;
+		header->size   = size;
+		header->offset = cast(i32)pad;
+
+		bin = size > 1 ? CM_MIN(cm__bit_msb(cast(u64)size), CM_TRACKING_HISTOGRAM_BINS-1) : 0;
+		cm__tracking_lock(t);
+		header->site = cm__tracking_site_get(t, cm__tracking_site_file, cm__tracking_site_line);
+		cm__tracking_add(t, header->site, size, 1);
+		t->total_count++;
+		t->histogram[bin]++;
+		if (header->site >= 0)
+			t->sites[header->site].total_count++;
+		cm__tracking_unlock(t);
+	} break;
+
+	case cmAllocation_Free: {
+		if (old_memory == NULL) return NULL;
+		header = cast(cmTrackingHeader *)old_memory - 1;
+		cm__tracking_lock(t);
+		cm__tracking_add(t, header->site, -header->size, -1);
+		cm__tracking_unlock(t);
+		t->backing.proc(t->backing.data, type, 0, 0, cast(u8 *)old_memory - header->offset, 0, flags);
+	} break;
+
+	case cmAllocation_FreeAll: {
+		isize i;
+		t->backing.proc(t->backing.data, type, 0, 0, NULL, 0, flags);
+		cm__tracking_lock(t);
+		t->live_bytes = 0;
+		t->live_count = 0;
+		for (i = 0; i < t->site_count; i++) {
+			t->sites[i].live_bytes = 0;
+			t->sites[i].live_count = 0;
+		}
+		cm__tracking_unlock(t);
+	} break;
+
+	case cmAllocation_Resize: {
+		isize prev_size;
+		if (old_memory == NULL || size == 0)
+			return cm_default_resize_align(cm_tracking_allocator(t), old_memory, old_size, size, alignment);
+
+		header = cast(cmTrackingHeader *)old_memory - 1;
+		if (header->offset != pad)
+			return cm_default_resize_align(cm_tracking_allocator(t), old_memory, old_size, size, alignment);
+
+		// NOTE: Same padding, so the backing allocator can resize (possibly in place) and the
+		// header moves with the data. old_size can be above the tracked size when the caller
+		// grew into the slack reported by cmAllocation_UsableSize, that has to be kept too.
+		prev_size = header->size;
+		raw = cast(u8 *)t->backing.proc(t->backing.data, type, size + pad, header_align,
+		                                cast(u8 *)old_memory - pad, CM_MAX(prev_size, old_size) + pad, flags);
+		if (raw == NULL)
+			return NULL;
+		ptr = raw + pad;
+		header = cast(cmTrackingHeader *)ptr - 1;
+		header->size = size;
+
+		cm__tracking_lock(t);
+		cm__tracking_add(t, header->site, size - prev_size, 0);
+		cm__tracking_unlock(t);
+	} break;
+
+	case cmAllocation_UsableSize: {
+		// NOTE: The header is in front, so the end of the backing block is the end of this one
+		if (old_memory == NULL) return NULL;
+		header = cast(cmTrackingHeader *)old_memory - 1;
+		ptr = t->backing.proc(t->backing.data, type, header->size + header->offset, 0,
+		                      cast(u8 *)old_memory - header->offset, 0, flags);
+	} break;
+
+	default:
+		break;
+	}
+
+	return ptr;
+}
+
+cm_internal CM_COMPARE_PROC(cm__tracking_site_cmp) {
+	isize x = (cast(cmTrackingSite const *)a)->live_bytes;
+	isize y = (cast(cmTrackingSite const *)b)->live_bytes;
+	return x < y ? +1 : x > y ? -1 : 0; // NOTE: Largest first
+}
+
+// NOTE: Copy of the sites sorted by live bytes, NULL if there are none
+cm_internal cmTrackingSite *
+cm__tracking_sorted_sites(cmTrackingAllocator *t, isize *count) {
+	cmTrackingSite *sites = NULL;
+	*count = t->site_count;
+	if (*count > 0) {
+		sites = cast(cmTrackingSite *)cm_alloc_copy(cm_heap_allocator(), t->sites, *count * cm_size_of(cmTrackingSite));
+		if (sites)
+			cm_sort(sites, *count, cm_size_of(cmTrackingSite), cm__tracking_site_cmp);
+		else
+			*count = 0;
+	}
+	return sites;
+}
+
+void
+cm_tracking_report(cmTrackingAllocator *t, cmFile *f) {
+	cmTrackingSite *sites;
+	isize i, count;
+
+	cm__tracking_lock(t);
+	cm_fprintf(f, "Live:  %td bytes in %td allocations\n", t->live_bytes, t->live_count);
+	cm_fprintf(f, "Peak:  %td bytes\n", t->peak_bytes);
+	cm_fprintf(f, "Total: %td bytes in %td allocations\n", t->total_bytes, t->total_count);
+
+	cm_fprintf(f, "Size histogram:\n");
+	for (i = 0; i < CM_TRACKING_HISTOGRAM_BINS; i++) {
+		if (t->histogram[i] == 0)
+			continue;
+		if (i == CM_TRACKING_HISTOGRAM_BINS-1)
+			cm_fprintf(f, "  >= %td bytes: %td\n", cast(isize)1 << i, t->histogram[i]);
+		else
+			cm_fprintf(f, "  <  %td bytes: %td\n", cast(isize)1 << (i+1), t->histogram[i]);
+	}
+
+	sites = cm__tracking_sorted_sites(t, &count);
+	cm__tracking_unlock(t);
+
+	if (count > 0) {
+		cm_fprintf(f, "Call sites by live bytes:\n");
+		for (i = 0; i < count; i++) {
+			cmTrackingSite *site = &sites[i];
+			cm_fprintf(f, "  %s:%d: live %td bytes in %td, peak %td bytes, total %td bytes in %td\n",
+			           site->file, site->line, site->live_bytes, site->live_count,
+			           site->peak_bytes, site->total_bytes, site->total_count);
+		}
+		cm_free(cm_heap_allocator(), sites);
+	}
+}
+
+cm_internal void
+cm__tracking_write_json_string(cmFile *f, char const *str) {
+	char const *start = str;
+	cm_file_write(f, "\"", 1);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			cm_file_write(f, start, str - start);
+			cm_file_write(f, "\\", 1);
+			start = str;
+		} else if (cast(u8)*str < 0x20) {
+			// NOTE: Control characters are not allowed raw in a JSON string
+			char escape[6] = {'\\', 'u', '0', '0', '0', '0'};
+			escape[4] += cast(u8)*str >> 4;
+			escape[5]  = "0123456789abcdef"[*str & 0xf];
+			cm_file_write(f, start, str - start);
+			cm_file_write(f, escape, 6);
+			start = str+1;
+		}
+	}
+	cm_file_write(f, start, str - start);
+	cm_file_write(f, "\"", 1);
+}
+
+void
+cm_tracking_dump_json(cmTrackingAllocator *t, cmFile *f) {
+	cmTrackingSite *sites;
+	isize i, count;
+
+	cm__tracking_lock(t);
+	cm_fprintf(f, "{\"live_bytes\":%td,\"live_count\":%td,\"peak_bytes\":%td,\"total_bytes\":%td,\"total_count\":%td,\"histogram\":[",
+	           t->live_bytes, t->live_count, t->peak_bytes, t->total_bytes, t->total_count);
+	for (i = 0; i < CM_TRACKING_HISTOGRAM_BINS; i++)
+		cm_fprintf(f, i ? ",%td" : "%td", t->histogram[i]);
+	sites = cm__tracking_sorted_sites(t, &count);
+	cm__tracking_unlock(t);
+
+	cm_fprintf(f, "],\"sites\":[");
+	for (i = 0; i < count; i++) {
+		cmTrackingSite *site = &sites[i];
+		cm_fprintf(f, i ? ",{\"file\":" : "{\"file\":");
+		cm__tracking_write_json_string(f, site->file);
+		cm_fprintf(f, ",\"line\":%d,\"live_bytes\":%td,\"live_count\":%td,\"peak_bytes\":%td,\"total_bytes\":%td,\"total_count\":%td}",
+		           site->line, site->live_bytes, site->live_count, site->peak_bytes, site->total_bytes, site->total_count);
+	}
+	cm_fprintf(f, "]}\n");
+
+	if (sites)
+		cm_free(cm_heap_allocator(), sites);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+//
+// Thread-Caching Heap Allocator
+//
+
+typedef struct cmTcHeapSpan cmTcHeapSpan;
+struct cmTcHeapSpan {
+	cmTcHeapSpan *next;
+	cmTcHeapSpan *prev;
+	void *        free_list;   // NOTE: Blocks returned to the span
+	u8 *          objects;
+	u8 *          bump;        // NOTE: Blocks after this have never been handed out
+	u8 *          end;
+	isize         class_index; // NOTE: -1 for a large allocation
+	isize         block_size;  // NOTE: Size of the mapping for a large allocation
+	u64           reciprocal;  // NOTE: ceil(2^48 / block_size), block index without a division
+	isize         used;
+	isize         span_count;
+	b32           in_partial;
+};
+
+#define CM__TC_HEAP_SPAN_HEADER ((cm_size_of(cmTcHeapSpan) + 63) & ~63)
+#define CM__TC_HEAP_SPAN_MASK   (cast(uintptr)CM_TC_HEAP_SPAN_SIZE - 1)
+#define CM__TC_HEAP_MIN_ALIGN   16
+
+typedef struct cmTcHeapCentral {
+	cmAtomic32    lock;
+	cmTcHeapSpan *partial; // NOTE: Spans with at least one block available
+} cmTcHeapCentral;
+
+// NOTE: Free runs of 1 to CM_TC_HEAP_MAX_RUN_SPANS spans, bucketed by span count
+typedef struct cmTcHeapPageHeap {
+	cmAtomic32    lock;
+	cmTcHeapSpan *free_runs[CM_TC_HEAP_MAX_RUN_SPANS+1];
+	isize         free_spans;
+	isize         page_size;
+} cmTcHeapPageHeap;
+
+typedef struct cmTcHeapCacheList {
+	void *head;
+	i32   count;
+	i32   max_count;
+} cmTcHeapCacheList;
+
+typedef struct cmTcHeapCache {
+	cmTcHeapCacheList lists[CM_TC_HEAP_CLASS_COUNT];
+	b32               initialized;
+} cmTcHeapCache;
+
+cm_global cmTcHeapCentral  cm__tc_heap_central[CM_TC_HEAP_CLASS_COUNT];
+cm_global cmTcHeapPageHeap cm__tc_heap_page_heap;
+cm_global cm_thread_local cmTcHeapCache cm__tc_heap_cache;
+
+#if !defined(CM_SYS_WINDOWS)
+cm_global pthread_key_t  cm__tc_heap_cache_key;
+cm_global pthread_once_t cm__tc_heap_cache_key_once = PTHREAD_ONCE_INIT;
+#endif
+
+
+cm_internal void
+cm__tc_heap_lock(cmAtomic32 volatile *lock) {
+	while (cm_atomic32_compare_exchange(lock, 0, 1) != 0) {
+		while (cm_atomic32_load(lock) != 0)
+			cm_yield_thread();
+	}
+}
+
+cm_internal void
+cm__tc_heap_unlock(cmAtomic32 volatile *lock) {
+	cm_mfence();
+	cm_atomic32_store(lock, 0);
+}
+
+// NOTE: 16 to 128 in steps of 16, then four classes per power of two up to 32 KB
+cm_internal isize
+cm__tc_heap_class_index(isize size) {
+	isize s, b;
+	if (size <= 128)
+		return size <= 0 ? 0 : ((size + 15) >> 4) - 1;
+	s = size - 1;
+	b = cm__bit_msb(cast(u64)s);
+	return 8 + (b - 7)*4 + ((s >> (b - 2)) & 3);
+}
+
+cm_internal isize
+cm__tc_heap_class_size(isize class_index) {
+	isize b, sub;
+	if (class_index < 8)
+		return (class_index + 1) * 16;
+	b   = 7 + (class_index - 8) / 4;
+	sub = (class_index - 8) % 4;
+	return (5 + sub) << (b - 2);
+}
+
+// NOTE: Number of blocks moved between a thread cache and the central list at once
+cm_internal i32
+cm__tc_heap_batch_count(isize class_index) {
+	isize count = cm_kilobytes(64) / cm__tc_heap_class_size(class_index);
+	return cast(i32)CM_CLAMP(count, 2, 32);
+}
+
+cm_inline cmTcHeapSpan *
+cm__tc_heap_span_of(void *ptr) {
+	return cast(cmTcHeapSpan *)(cast(uintptr)ptr & ~CM__TC_HEAP_SPAN_MASK);
+}
+
+cm_internal void *
+cm__tc_heap_block_of(cmTcHeapSpan *span, void *ptr) {
+	u64 offset = cast(u64)cm_pointer_diff(span->objects, ptr);
+	u64 index  = (offset * span->reciprocal) >> 48;
+	return span->objects + index*span->block_size;
+}
+
+// NOTE: Maps `size` bytes whose start is aligned to CM_TC_HEAP_SPAN_SIZE
+
+cm_internal cmTcHeapSpan *
+cm__tc_heap_page_heap_get(isize span_count) {
+	cmTcHeapPageHeap *ph = &cm__tc_heap_page_heap;
+	cmTcHeapSpan *span = NULL;
+
+	if (span_count <= CM_TC_HEAP_MAX_RUN_SPANS) {
+		cm__tc_heap_lock(&ph->lock);
+		if (ph->page_size == 0)
+			ph->page_size = cm_virtual_memory_page_size(NULL);
+
+		if (ph->free_runs[span_count] == NULL && span_count == 1) {
+			isize i;
+			u8 *chunk = cast(u8 *)cm_vm_alloc_aligned(CM_TC_HEAP_CHUNK_SPANS * CM_TC_HEAP_SPAN_SIZE, CM_TC_HEAP_SPAN_SIZE, 0).data;
+			if (chunk) {
+				for (i = CM_TC_HEAP_CHUNK_SPANS-1; i >= 0; i--) {
+					cmTcHeapSpan *s = cast(cmTcHeapSpan *)(chunk + i*CM_TC_HEAP_SPAN_SIZE);
+					s->span_count = 1;
+					s->next = ph->free_runs[1];
+					ph->free_runs[1] = s;
+				}
+				ph->free_spans += CM_TC_HEAP_CHUNK_SPANS;
+			}
+		}
+
+		span = ph->free_runs[span_count];
+		if (span) {
+			ph->free_runs[span_count] = span->next;
+			ph->free_spans -= span_count;
+		}
+		cm__tc_heap_unlock(&ph->lock);
+	}
+
+	if (span == NULL && span_count > 1) {
+		span = cast(cmTcHeapSpan *)cm_vm_alloc_aligned(span_count * CM_TC_HEAP_SPAN_SIZE, CM_TC_HEAP_SPAN_SIZE, 0).data;
+		if (span)
+			span->span_count = span_count;
+	}
+	return span;
+}
+
+cm_internal void
+cm__tc_heap_page_heap_put(cmTcHeapSpan *span) {
+	cmTcHeapPageHeap *ph = &cm__tc_heap_page_heap;
+	isize span_count = span->span_count;
+	isize size = span_count * CM_TC_HEAP_SPAN_SIZE;
+	b32 over_limit;
+
+	if (span_count > CM_TC_HEAP_MAX_RUN_SPANS) {
+		cm_vm_free(cm_virtual_memory(span, size));
+		return;
+	}
+
+	cm__tc_heap_lock(&ph->lock);
+	over_limit = ph->free_spans + span_count > CM_TC_HEAP_MAX_FREE_SPANS;
+	if (over_limit) {
+		cm__tc_heap_unlock(&ph->lock);
+		if (span_count > 1) {
+			cm_vm_free(cm_virtual_memory(span, size));
+			return;
+		}
+		// NOTE: Single spans are carved from shared chunks and cannot be unmapped on their own,
+		// purge all but the first page, which holds the link to the next free span. This has to
+		// happen before the span is linked, another thread may take it as soon as it is.
+		cm_vm_purge(cm_virtual_memory(cm_pointer_add(span, ph->page_size), size - ph->page_size));
+		cm__tc_heap_lock(&ph->lock);
+	}
+	span->next = ph->free_runs[span_count];
+	ph->free_runs[span_count] = span;
+	ph->free_spans += span_count;
+	cm__tc_heap_unlock(&ph->lock);
+}
+
+
+cm_internal void
+cm__tc_heap_partial_link(cmTcHeapCentral *c, cmTcHeapSpan *span) {
+	span->prev = NULL;
+	span->next = c->partial;
+	if (c->partial)
+		c->partial->prev = span;
+	c->partial = span;
+	span->in_partial = true;
+}
+
+cm_internal void
+cm__tc_heap_partial_unlink(cmTcHeapCentral *c, cmTcHeapSpan *span) {
+	if (span->prev)
+		span->prev->next = span->next;
+	else
+		c->partial = span->next;
+	if (span->next)
+		span->next->prev = span->prev;
+	span->next = span->prev = NULL;
+	span->in_partial = false;
+}
+
+// NOTE: Pushes up to `count` blocks onto the cache list, returns how many were moved
+cm_internal i32
+cm__tc_heap_central_fetch(isize class_index, cmTcHeapCacheList *list, i32 count) {
+	cmTcHeapCentral *c = &cm__tc_heap_central[class_index];
+	i32 fetched = 0;
+
+	cm__tc_heap_lock(&c->lock);
+	while (fetched < count) {
+		cmTcHeapSpan *span = c->partial;
+		void *block;
+
+		if (span == NULL) {
+			isize block_size = cm__tc_heap_class_size(class_index);
+			span = cm__tc_heap_page_heap_get(1);
+			if (span == NULL)
+				break;
+			span->free_list   = NULL;
+			span->objects     = cast(u8 *)span + CM__TC_HEAP_SPAN_HEADER;
+			span->bump        = span->objects;
+			span->end         = span->objects + ((CM_TC_HEAP_SPAN_SIZE - CM__TC_HEAP_SPAN_HEADER) / block_size) * block_size;
+			span->class_index = class_index;
+			span->block_size  = block_size;
+			span->reciprocal  = ((cast(u64)1 << 48) + block_size - 1) / block_size;
+			span->used        = 0;
+			cm__tc_heap_partial_link(c, span);
+		}
+
+		if (span->free_list) {
+			block = span->free_list;
+			span->free_list = *cast(void **)block;
+		} else {
+			block = span->bump;
+			span->bump += span->block_size;
+		}
+		span->used++;
+		if (span->free_list == NULL && span->bump == span->end)
+			cm__tc_heap_partial_unlink(c, span);
+
+		*cast(void **)block = list->head;
+		list->head = block;
+		fetched++;
+	}
+	cm__tc_heap_unlock(&c->lock);
+
+	list->count += fetched;
+	return fetched;
+}
+
+// NOTE: Pops `count` blocks off the cache list and gives them back to their spans
+cm_internal void
+cm__tc_heap_central_release(isize class_index, cmTcHeapCacheList *list, i32 count) {
+	cmTcHeapCentral *c = &cm__tc_heap_central[class_index];
+
+	cm__tc_heap_lock(&c->lock);
+	while (count-- > 0 && list->head) {
+		void *block = list->head;
+		cmTcHeapSpan *span = cm__tc_heap_span_of(block);
+		list->head = *cast(void **)block;
+		list->count--;
+
+		*cast(void **)block = span->free_list;
+		span->free_list = block;
+		if (!span->in_partial)
+			cm__tc_heap_partial_link(c, span);
+
+		if (--span->used == 0) {
+			cm__tc_heap_partial_unlink(c, span);
+			cm__tc_heap_page_heap_put(span);
+		}
+	}
+	cm__tc_heap_unlock(&c->lock);
+}
+
+
+#if !defined(CM_SYS_WINDOWS)
+cm_internal void
+cm__tc_heap_cache_destructor(void *cache) {
+	cm_unused(cache);
+	cm_tc_heap_thread_flush();
+}
+
+cm_internal void
+cm__tc_heap_cache_key_init(void) {
+	pthread_key_create(&cm__tc_heap_cache_key, cm__tc_heap_cache_destructor);
+}
+#endif
+
+cm_internal cmTcHeapCache *
+cm__tc_heap_cache_get(void) {
+	cmTcHeapCache *tc = &cm__tc_heap_cache;
+	if (!tc->initialized) {
+		isize i;
+		for (i = 0; i < CM_TC_HEAP_CLASS_COUNT; i++)
+			tc->lists[i].max_count = 4 * cm__tc_heap_batch_count(i);
+		tc->initialized = true;
+	#if !defined(CM_SYS_WINDOWS)
+		pthread_once(&cm__tc_heap_cache_key_once, cm__tc_heap_cache_key_init);
+		pthread_setspecific(cm__tc_heap_cache_key, tc);
+	#endif
+	}
+	return tc;
+}
+
+void
+cm_tc_heap_thread_flush(void) {
+	cmTcHeapCache *tc = &cm__tc_heap_cache;
+	isize i;
+	if (!tc->initialized)
+		return;
+	for (i = 0; i < CM_TC_HEAP_CLASS_COUNT; i++) {
+		cmTcHeapCacheList *list = &tc->lists[i];
+		if (list->count > 0)
+			cm__tc_heap_central_release(i, list, list->count);
+	}
+}
+
+
+// NOTE: Large allocations are a run of whole spans with the header in the first one
+cm_internal void *
+cm__tc_heap_large_alloc(isize size, isize alignment) {
+	isize total = CM__TC_HEAP_SPAN_HEADER + size + alignment;
+	isize span_count = (total + CM_TC_HEAP_SPAN_SIZE - 1) / CM_TC_HEAP_SPAN_SIZE;
+	cmTcHeapSpan *span = cm__tc_heap_page_heap_get(span_count);
+	if (span == NULL)
+		return NULL;
+
+	span->class_index = -1;
+	span->block_size  = span_count * CM_TC_HEAP_SPAN_SIZE;
+	return cm_align_forward(cast(u8 *)span + CM__TC_HEAP_SPAN_HEADER, alignment);
+}
+
+cm_internal isize
+cm__tc_heap_usable_size(void *ptr) {
+	cmTcHeapSpan *span = cm__tc_heap_span_of(ptr);
+	if (span->class_index < 0)
+		return span->block_size - cm_pointer_diff(span, ptr);
+	return cast(isize)(cast(u8 *)cm__tc_heap_block_of(span, ptr) + span->block_size - cast(u8 *)ptr);
+}
+
+cm_internal void *
+cm__tc_heap_alloc(isize size, isize alignment) {
+	cmTcHeapCache *tc;
+	cmTcHeapCacheList *list;
+	isize class_index;
+	void *block;
+
+	CM_ASSERT(cm_is_power_of_two(alignment));
+	CM_ASSERT_MSG(alignment <= CM_TC_HEAP_SPAN_SIZE/2, "Alignment too large for the heap: %td", alignment);
+
+	// NOTE: Blocks are only 16 byte aligned, so over-allocate and align inside the block
+	if (alignment > CM__TC_HEAP_MIN_ALIGN)
+		size += alignment - CM__TC_HEAP_MIN_ALIGN;
+	if (size > CM_TC_HEAP_MAX_SMALL_SIZE)
+		return cm__tc_heap_large_alloc(size, alignment);
+
+	tc = cm__tc_heap_cache_get();
+	class_index = cm__tc_heap_class_index(size);
+	list = &tc->lists[class_index];
+	if (list->head == NULL &&
+	    cm__tc_heap_central_fetch(class_index, list, cm__tc_heap_batch_count(class_index)) == 0) {
+		return NULL;
+	}
+
+	block = list->head;
+	list->head = *cast(void **)block;
+	list->count--;
+
+	if (alignment > CM__TC_HEAP_MIN_ALIGN)
+		block = cm_align_forward(block, alignment);
+	return block;
+}
+
+cm_internal void
+cm__tc_heap_free(void *ptr) {
+	cmTcHeapSpan *span = cm__tc_heap_span_of(ptr);
+	cmTcHeapCache *tc;
+	cmTcHeapCacheList *list;
+	void *block;
+
+	if (span->class_index < 0) {
+		cm__tc_heap_page_heap_put(span);
+		return;
+	}
+
+	tc = cm__tc_heap_cache_get();
+	list = &tc->lists[span->class_index];
+	block = cm__tc_heap_block_of(span, ptr);
+	*cast(void **)block = list->head;
+	list->head = block;
+	if (++list->count > list->max_count)
+		cm__tc_heap_central_release(span->class_index, list, cm__tc_heap_batch_count(span->class_index));
+}
+
+// NOTE: Returns how many of the `count` blocks were allocated
+cm_internal isize
+cm__tc_heap_alloc_batch(void **ptrs, isize count, isize size, isize alignment) {
+	cmTcHeapCache *tc;
+	cmTcHeapCacheList *list;
+	isize class_index, i;
+
+	CM_ASSERT(cm_is_power_of_two(alignment));
+	if (alignment > CM__TC_HEAP_MIN_ALIGN)
+		size += alignment - CM__TC_HEAP_MIN_ALIGN;
+	if (size > CM_TC_HEAP_MAX_SMALL_SIZE) {
+		for (i = 0; i < count; i++) {
+			ptrs[i] = cm__tc_heap_large_alloc(size, alignment);
+			if (ptrs[i] == NULL)
+				break;
+		}
+		return i;
+	}
+
+	tc = cm__tc_heap_cache_get();
+	class_index = cm__tc_heap_class_index(size);
+	list = &tc->lists[class_index];
+	for (i = 0; i < count; i++) {
+		void *block;
+		if (list->head == NULL &&
+		    cm__tc_heap_central_fetch(class_index, list, cm__tc_heap_batch_count(class_index)) == 0) {
+			break;
+		}
+		block = list->head;
+		list->head = *cast(void **)block;
+		list->count--;
+		ptrs[i] = alignment > CM__TC_HEAP_MIN_ALIGN ? cm_align_forward(block, alignment) : block;
+	}
+	return i;
+}
+
+cm_inline cmAllocator
+cm_tc_heap_allocator(void) {
+	cmAllocator a;
+	a.proc = cm_tc_heap_allocator_proc;
+	a.data = NULL;
+	return a;
+}
+
+CM_ALLOCATOR_PROC(cm_tc_heap_allocator_proc) {
+	void *ptr = NULL;
+	cm_unused(allocator_data);
+	cm_unused(old_size);
+
+	switch (type) {
+	case cmAllocation_Alloc:
+		ptr = cm__tc_heap_alloc(size, alignment);
+		if (ptr && (flags & cmAllocatorFlag_ClearToZero))
+			cm_zero_size(ptr, size);
+		break;
+
+	case cmAllocation_Free:
+		if (old_memory)
+			cm__tc_heap_free(old_memory);
+		break;
+
+	case cmAllocation_AllocBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i, n = cm__tc_heap_alloc_batch(ptrs, old_size, size, alignment);
+		if (flags & cmAllocatorFlag_ClearToZero) {
+			for (i = 0; i < n; i++)
+				cm_zero_size(ptrs[i], size);
+		}
+		if (n == old_size)
+			ptr = ptrs;
+	} break;
+
+	case cmAllocation_FreeBatch: {
+		void **ptrs = cast(void **)old_memory;
+		isize i;
+		for (i = 0; i < old_size; i++) {
+			if (ptrs[i])
+				cm__tc_heap_free(ptrs[i]);
+		}
+		ptr = ptrs;
+	} break;
+
+	case cmAllocation_UsableSize:
+		ptr = cast(u8 *)old_memory + cm__tc_heap_usable_size(old_memory);
+		break;
+
+	case cmAllocation_FreeAll:
+		break;
+
+	case cmAllocation_Resize: {
+		isize usable;
+		if (old_memory == NULL) {
+			ptr = cm__tc_heap_alloc(size, alignment);
+			break;
+		}
+		if (size == 0) {
+			cm__tc_heap_free(old_memory);
+			break;
+		}
+
+		// NOTE: Stay in place if the block fits and would not be more than half empty
+		usable = cm__tc_heap_usable_size(old_memory);
+		if (size <= usable && size >= usable/2 &&
+		    (cast(uintptr)old_memory & (alignment-1)) == 0) {
+			ptr = old_memory;
+			break;
+		}
+
+		ptr = cm__tc_heap_alloc(size, alignment);
+		if (ptr == NULL)
+			break;
+		cm_memcopy(ptr, old_memory, CM_MIN(usable, size));
+		cm__tc_heap_free(old_memory);
+	} break;
 	}
 
 	return ptr;
@@ -19,6 +19,9 @@
 #include "dll.h"
 #include "types.h"
 #include "utils.h"
+#include "assert.h"
+#include "arch.h"
+#include "atomics.h"
 
 
 CM_BEGIN_EXTERN
@@ -52,6 +55,16 @@ CM_DEF void			cm_memswap    (void *i, void *j, isize size);
 CM_DEF void const 	*cm_memchr    (void const *data, u8 byte_value, isize size);
 CM_DEF void const 	*cm_memrchr   (void const *data, u8 byte_value, isize size);
 
+// NOTE: Non-temporal versions that bypass the cache, for large buffers that will not be
+// read again soon. cm_memcopy and cm_memset switch to them from CM_MEMORY_STREAM_THRESHOLD
+// bytes, define it as 0 to turn that off.
+#ifndef CM_MEMORY_STREAM_THRESHOLD
+#define CM_MEMORY_STREAM_THRESHOLD (4 * 1024 * 1024)
+#endif
+
+CM_DEF void 		*cm_memcopy_stream(void *dest, void const *source, isize size);
+CM_DEF void 		*cm_memset_stream (void *data, u8 byte_value, isize size);
+
 
 #ifndef cm_memcopy_array
 #define cm_memcopy_array(dst, src, count) cm_memcopy((dst), (src), cm_size_of(*(dst))*(count))
@@ -75,11 +88,51 @@ typedef struct cmVirtualMemory {
 
 CM_DEF cmVirtualMemory cm_virtual_memory(void *data, isize size);
 CM_DEF cmVirtualMemory cm_vm_alloc      (void *addr, isize size);
+CM_DEF cmVirtualMemory cm_vm_reserve    (void *addr, isize size); // NOTE: Address space only, cm_vm_commit before use
+CM_DEF b32             cm_vm_commit     (cmVirtualMemory vm);
 CM_DEF b32             cm_vm_free       (cmVirtualMemory vm);
 CM_DEF cmVirtualMemory cm_vm_trim       (cmVirtualMemory vm, isize lead_size, isize size);
 CM_DEF b32             cm_vm_purge      (cmVirtualMemory vm);
 CM_DEF isize           cm_virtual_memory_page_size(isize *alignment_out);
 
+// NOTE: Huge pages cut TLB misses on large regions. HugePages asks for explicit huge pages
+// (MAP_HUGETLB, MEM_LARGE_PAGES) and rounds the size up to the huge page size, falling back
+// to TransparentHugePages when none are available. TransparentHugePages maps a region
+// aligned to the huge page size and madvises it (Linux only), falling back to normal pages.
+typedef enum cmVirtualMemoryFlag {
+	cmVirtualMemoryFlag_HugePages            = CM_BIT(0),
+	cmVirtualMemoryFlag_TransparentHugePages = CM_BIT(1),
+} cmVirtualMemoryFlag;
+
+#define CM_HUGE_PAGE_SIZE (2 * 1024 * 1024) // NOTE: Default when the OS does not say
+
+CM_DEF cmVirtualMemory cm_vm_alloc_flags      (void *addr, isize size, u32 flags);
+CM_DEF cmVirtualMemory cm_vm_alloc_aligned    (isize size, isize alignment, u32 flags); // NOTE: alignment is a power of two, at least the page size
+CM_DEF b32             cm_vm_advise_huge_pages(cmVirtualMemory vm);
+CM_DEF isize           cm_vm_huge_page_size   (void);
+
+
+////////////////////////////////////////////////////////////////
+//
+// NUMA
+//
+// Nodes are discovered from /sys/devices/system/node. Memory is placed with the mbind and
+// set_mempolicy syscalls using the preferred policy, so a full node spills over to the
+// others instead of failing. Everywhere else there is a single node 0 and binding is a no-op.
+//
+////////////////////////////////////////////////////////////////
+
+#define CM_NUMA_MAX_NODES    64
+#define CM_NUMA_MAX_CPUS     1024
+#define CM_NUMA_CURRENT_NODE (-1) // NOTE: The node of the CPU the calling thread runs on
+
+CM_DEF isize           cm_numa_node_count     (void);
+CM_DEF isize           cm_numa_current_node   (void);
+CM_DEF b32             cm_numa_set_thread_node(isize node); // NOTE: Policy for the thread's new pages, -1 goes back to first touch
+
+CM_DEF b32             cm_vm_bind_node (cmVirtualMemory vm, isize node); // NOTE: Before the pages are first touched
+CM_DEF cmVirtualMemory cm_vm_alloc_node(isize size, isize node);
+
 
 ////////////////////////////////////////////////////////////////
 //
@@ -92,8 +145,15 @@ typedef enum cmAllocationType {
 	cmAllocation_Free,
 	cmAllocation_FreeAll,
 	cmAllocation_Resize,
+	cmAllocation_AllocBatch, // NOTE: old_memory is a void *[old_size] to fill with blocks of `size` bytes
+	cmAllocation_FreeBatch,  // NOTE: old_memory is a void *[old_size] of blocks to free, NULLs are skipped
+	cmAllocation_UsableSize, // NOTE: Returns the end of the usable part of old_memory's block, NULL if unknown
 } cmAllocationType;
 
+// NOTE: A proc returns old_memory when it handled a whole batch and NULL otherwise. Blocks it
+// did allocate come first, cm_alloc_batch and cm_free_batch do the rest one call at a time,
+// so allocators that do not know the batch types need nothing special.
+
 // NOTE(bill): This is useful so you can define an allocator of the same type and parameters
 #define CM_ALLOCATOR_PROC(name)                         \
 void *name(void *allocator_data, cmAllocationType type, \
@@ -126,6 +186,15 @@ CM_DEF void  		cm_free        	(cmAllocator a, void *ptr);
 CM_DEF void  		cm_free_all    	(cmAllocator a);
 CM_DEF void 		*cm_resize      (cmAllocator a, void *ptr, isize old_size, isize new_size);
 CM_DEF void 		*cm_resize_align(cmAllocator a, void *ptr, isize old_size, isize new_size, isize alignment);
+
+// NOTE: Returns how many blocks were allocated, those are the first entries of `ptrs` and the rest are NULL
+CM_DEF isize 		cm_alloc_batch_align(cmAllocator a, void **ptrs, isize count, isize size, isize alignment);
+CM_DEF isize 		cm_alloc_batch      (cmAllocator a, void **ptrs, isize count, isize size);
+CM_DEF void  		cm_free_batch       (cmAllocator a, void **ptrs, isize count);
+
+// NOTE: How many bytes of the block at `ptr`, allocated with `size` bytes, may actually be used.
+// Size classed allocators round blocks up, containers can grow into the difference for free.
+CM_DEF isize 		cm_usable_size(cmAllocator a, void *ptr, isize size);
 // TODO(bill): For gb_resize, should the use need to pass the old_size or only the new_size?
 
 CM_DEF void 		*cm_alloc_copy      (cmAllocator a, void const *src, isize size);
@@ -145,8 +214,8 @@ CM_DEF void *cm_default_resize_align(cmAllocator a, void *ptr, isize old_size, i
 
 
 
-// TODO(bill): Probably use a custom heap allocator system that doesn't depend on malloc/free
-// Base it off TCMalloc or something else? Or something entirely custom?
+// NOTE: cm_heap_allocator forwards to the thread-caching heap below.
+// Define CM_HEAP_USE_SYSTEM_MALLOC to go back to the C runtime's aligned malloc/free.
 CM_DEF cmAllocator cm_heap_allocator(void);
 CM_DEF CM_ALLOCATOR_PROC(cm_heap_allocator_proc);
 
@@ -170,19 +239,39 @@ typedef struct cmArena {
 	isize       total_size;
 	isize       total_allocated;
 	isize       temp_count;
+	void *      last_alloc; // NOTE: Top allocation, the only one that can be resized in place
+
+	// NOTE: Only used by virtual arenas, total_size is the reserved address space
+	b32         is_virtual;
+	isize       committed;
+	isize       high_water_mark;
+	isize       peak_allocated; // NOTE: Highest total_allocated since the last free all
 } cmArena;
 
+#ifndef CM_ARENA_COMMIT_SIZE
+#define CM_ARENA_COMMIT_SIZE (64 * 1024)
+#endif
+
 CM_DEF void 			cm_arena_init_from_memory   (cmArena *arena, void *start, isize size);
 CM_DEF void 			cm_arena_init_from_allocator(cmArena *arena, cmAllocator backing, isize size);
 CM_DEF void 			cm_arena_init_sub           (cmArena *arena, cmArena *parent_arena, isize size);
 CM_DEF void 			cm_arena_free               (cmArena *arena);
 
+// NOTE: Reserves `reserve_size` bytes of address space and commits it in CM_ARENA_COMMIT_SIZE steps as it fills.
+// A free all purges the pages above `high_water_mark` that were used since the last one so their physical
+// memory goes back to the OS, resets that stay under the mark make no system call.
+CM_DEF b32  			cm_arena_init_virtual       (cmArena *arena, isize reserve_size, isize high_water_mark);
+
 CM_DEF isize 			cm_arena_alignment_of  (cmArena *arena, isize alignment);
 CM_DEF isize 			cm_arena_size_remaining(cmArena *arena, isize alignment);
 CM_DEF void  			cm_arena_check         (cmArena *arena);
 
+// NOTE: Grows or shrinks `ptr` in place if it is the most recent allocation, returns false otherwise.
+// Allocations made before the latest cm_temp_arena_memory_begin cannot be extended.
+CM_DEF b32   			cm_arena_try_extend    (cmArena *arena, void *ptr, isize new_size);
+
 
-// Allocation Types: alloc, free_all, resize
+// Allocation Types: alloc, free (top only), free_all, resize
 CM_DEF cmAllocator 		cm_arena_allocator(cmArena *arena);
 CM_DEF CM_ALLOCATOR_PROC(cm_arena_allocator_proc);
 
@@ -219,6 +308,136 @@ CM_DEF cmAllocator cm_pool_allocator(cmPool *pool);
 CM_DEF CM_ALLOCATOR_PROC(cm_pool_allocator_proc);
 
 
+///////////////////////////////////////////////////////////
+//
+// Concurrent Pool Allocator
+//
+// Thread-safe cmPool. Each thread keeps two magazines (small stacks of free blocks)
+// per pool, so most allocs and frees touch no shared memory. Full and empty magazines
+// are exchanged with a lock-free depot: a Treiber stack whose head packs a generation
+// tag next to the pointer to defeat ABA. When the depot runs dry a new chunk of
+// blocks is taken from the backing allocator, which must itself be thread-safe.
+//
+// NOTE: Up to CM_POOL_MAX_THREADS threads get their own magazines, any others go
+// through the depot on every call. Thread slots are recycled on exit with pthreads.
+//
+////////////////////////////////////////////////////////////////
+
+#ifndef CM_POOL_MAGAZINE_SIZE
+#define CM_POOL_MAGAZINE_SIZE 32
+#endif
+
+#define CM_POOL_MAX_THREADS 64
+
+typedef struct cmPoolMagazine cmPoolMagazine;
+struct cmPoolMagazine {
+	cmPoolMagazine *next;     // NOTE: Depot link
+	cmPoolMagazine *all_next; // NOTE: Every magazine of the pool, for cm_concurrent_pool_free
+	isize           count;
+	void *          blocks[CM_POOL_MAGAZINE_SIZE];
+};
+
+typedef struct cmPoolThreadCache {
+	cmPoolMagazine *loaded;
+	cmPoolMagazine *previous;
+	u8              padding[CM_CACHE_LINE_SIZE - 2*cm_size_of(void *)];
+} cmPoolThreadCache;
+
+typedef struct cmConcurrentPool {
+	cmAllocator        backing;
+	isize              block_size;
+	isize              block_align;
+	isize              block_stride;
+	isize              chunk_blocks;
+
+	cmAtomic64         full;      // NOTE: Tagged head of magazines holding blocks
+	cmAtomic64         empty;     // NOTE: Tagged head of empty magazines
+	cmAtomicPtr        chunks;
+	cmAtomicPtr        magazines;
+	cmAtomic64         total_size;
+
+	cmPoolThreadCache *caches;    // NOTE: CM_POOL_MAX_THREADS entries
+} cmConcurrentPool;
+
+CM_DEF void 			cm_concurrent_pool_init      (cmConcurrentPool *pool, cmAllocator backing, isize chunk_blocks, isize block_size);
+CM_DEF void 			cm_concurrent_pool_init_align(cmConcurrentPool *pool, cmAllocator backing, isize chunk_blocks, isize block_size, isize block_align);
+CM_DEF void 			cm_concurrent_pool_free      (cmConcurrentPool *pool);
+
+// Allocation Types: alloc, free
+CM_DEF cmAllocator cm_concurrent_pool_allocator(cmConcurrentPool *pool);
+CM_DEF CM_ALLOCATOR_PROC(cm_concurrent_pool_allocator_proc);
+
+
+///////////////////////////////////////////////////////////
+//
+// Slab Allocator
+//
+// Serves variable sized small allocations from size classes of 16 B to 32 KB, powers
+// of two and the halfway point between them. Each class owns slabs of CM_SLAB_SIZE
+// bytes mapped with cm_vm_alloc and aligned to their size, each holding a cmPool of
+// the class's block size, so a pointer finds its slab by masking off the low bits.
+// Larger allocations go to the backing allocator.
+//
+////////////////////////////////////////////////////////////////
+
+#define CM_SLAB_SIZE        (256 * 1024)
+#define CM_SLAB_MAX_SIZE    (32 * 1024)
+#define CM_SLAB_CLASS_COUNT 22
+
+typedef struct cmSlab cmSlab;
+struct cmSlab {
+	cmPool  pool;
+	cmSlab *next; // NOTE: Links in the class's partial list
+	cmSlab *prev;
+	isize   class_index;
+	isize   used;
+	b32     in_partial;
+};
+
+typedef struct cmSlabClass {
+	cmSlab *partial; // NOTE: Slabs with at least one free block
+	cmSlab *empty;   // NOTE: One empty slab is kept around to avoid remapping
+	isize   block_size;
+	isize   block_align;
+} cmSlabClass;
+
+typedef struct cmSlabAllocator {
+	cmAllocator backing;
+	cmSlabClass classes[CM_SLAB_CLASS_COUNT];
+
+	// NOTE: Open addressing set of every slab, tells slab blocks from backing allocations
+	cmSlab **   slabs;
+	isize       slab_count;
+	isize       slab_capacity;
+
+	isize       total_size; // NOTE: Bytes handed out from slabs
+	isize       numa_node;  // NOTE: Slabs are bound to this node, -1 for no binding
+} cmSlabAllocator;
+
+CM_DEF void 			cm_slab_init(cmSlabAllocator *s, cmAllocator backing);
+CM_DEF void 			cm_slab_free(cmSlabAllocator *s);
+
+// Allocation Types: alloc, free, free_all (slabs only), resize
+CM_DEF cmAllocator cm_slab_allocator(cmSlabAllocator *s);
+CM_DEF CM_ALLOCATOR_PROC(cm_slab_allocator_proc);
+
+
+///////////////////////////////////////////////////////////
+//
+// NUMA Allocator
+//
+// Thread-safe allocator placing memory on `node`, or with CM_NUMA_CURRENT_NODE on the node
+// the calling thread runs on at the time of each allocation. Every node has a slab allocator
+// of its own behind a lock, allocations too large for it are mapped directly. Memory may be
+// freed from any thread. On single node machines this is just cm_heap_allocator.
+//
+////////////////////////////////////////////////////////////////
+
+// Allocation Types: alloc, free, resize
+CM_DEF cmAllocator cm_numa_allocator(isize node);
+CM_DEF CM_ALLOCATOR_PROC(cm_numa_allocator_proc);
+
+
 
 // NOTE(bill): Used for allocators to keep track of sizes
 typedef struct cmAllocationHeader {
@@ -244,6 +463,7 @@ CM_DEF void                cm_allocation_header_fill(cmAllocationHeader *header,
 // as I am just being lazy. Also, I will probably remove it later; it's only here because why not?!
 //
 // NOTE(bill): I may also complete remove this if I completely implement a fixed heap allocator
+// NOTE: Which now exists, see cmFixedHeap below
 //
 //////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -271,6 +491,63 @@ CM_DEF cmAllocator 		cm_free_list_allocator(cmFreeList *fl);
 CM_DEF CM_ALLOCATOR_PROC(cm_free_list_allocator_proc);
 
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Fixed Heap Allocator - TLSF (Two-Level Segregated Fit)
+//
+// O(1) alloc and free over a fixed region. Free blocks are kept in a two level table of
+// size classes: the first level splits by power of two, the second splits each power of two
+// into CM_FIXED_HEAP_SL_COUNT linear steps. A bitmap per level finds the smallest non-empty
+// class that fits with two bit scans. Freed blocks are merged with their free neighbours
+// immediately, so no two free blocks are ever adjacent.
+//
+// Prefer this to cmFreeList, it does not walk any list.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define CM_FIXED_HEAP_ALIGN_LOG2 4
+#define CM_FIXED_HEAP_SL_LOG2    5
+#define CM_FIXED_HEAP_SL_COUNT   (1 << CM_FIXED_HEAP_SL_LOG2)
+#define CM_FIXED_HEAP_FL_SHIFT   (CM_FIXED_HEAP_SL_LOG2 + CM_FIXED_HEAP_ALIGN_LOG2)
+#if defined(CM_ARCH_64)
+#define CM_FIXED_HEAP_FL_MAX     40 // NOTE: Blocks up to 1 TB
+#else
+#define CM_FIXED_HEAP_FL_MAX     30 // NOTE: Blocks up to 1 GB
+#endif
+#define CM_FIXED_HEAP_FL_COUNT   (CM_FIXED_HEAP_FL_MAX - CM_FIXED_HEAP_FL_SHIFT + 1)
+
+typedef struct cmFixedHeapBlock cmFixedHeapBlock;
+struct cmFixedHeapBlock {
+	cmFixedHeapBlock *prev_phys;
+	isize             size;      // NOTE: Payload size, bit 0 is set when the block is free
+
+	// NOTE: Only valid while the block is free, otherwise this is the start of user memory
+	cmFixedHeapBlock *next_free;
+	cmFixedHeapBlock *prev_free;
+};
+
+typedef struct cmFixedHeap {
+	cmAllocator       backing;
+	void *            physical_start;
+	isize             total_size;
+
+	isize             total_allocated;
+	isize             allocation_count;
+
+	u32               fl_bitmap;
+	u32               sl_bitmap[CM_FIXED_HEAP_FL_COUNT];
+	cmFixedHeapBlock *blocks[CM_FIXED_HEAP_FL_COUNT][CM_FIXED_HEAP_SL_COUNT];
+} cmFixedHeap;
+
+CM_DEF void 			cm_fixed_heap_init               (cmFixedHeap *h, void *start, isize size);
+CM_DEF void 			cm_fixed_heap_init_from_allocator(cmFixedHeap *h, cmAllocator backing, isize size);
+CM_DEF void 			cm_fixed_heap_free               (cmFixedHeap *h);
+
+// Allocation Types: alloc, free, free_all, resize
+CM_DEF cmAllocator 		cm_fixed_heap_allocator(cmFixedHeap *h);
+CM_DEF CM_ALLOCATOR_PROC(cm_fixed_heap_allocator_proc);
+
+
 ///////////////////////////////////////////////////////////////
 //
 // Scratch Memory Allocator - Ring Buffer Based Arena
@@ -292,9 +569,205 @@ CM_DEF b32  			cm_scratch_memory_is_in_use(cmScratchMemory *s, void *ptr);
 CM_DEF cmAllocator 		cm_scratch_allocator(cmScratchMemory *s);
 CM_DEF CM_ALLOCATOR_PROC(cm_scratch_allocator_proc);
 
-// TODO(bill): Stack allocator
-// TODO(bill): Fixed heap allocator
-// TODO(bill): General heap allocator. Maybe a TCMalloc like clone?
+
+///////////////////////////////////////////////////////////////
+//
+// Thread Scratch Arenas
+//
+// Every thread has CM_SCRATCH_ARENA_COUNT virtual arenas for short lived memory, reserved
+// on first use and released when the thread exits. cm_scratch_begin hands out one that is
+// not in `conflicts`, so a function can take scratch memory while writing its result to an
+// arena its caller got the same way. No locks are involved.
+//
+//	cmTempArenaMemory scratch = cm_scratch_begin(&out_arena, 1);
+//	cmAllocator a = cm_arena_allocator(scratch.arena);
+//	...
+//	cm_scratch_end(scratch);
+//
+///////////////////////////////////////////////////////////////
+
+#ifndef CM_SCRATCH_ARENA_COUNT
+#define CM_SCRATCH_ARENA_COUNT 2
+#endif
+
+#ifndef CM_SCRATCH_ARENA_RESERVE
+#define CM_SCRATCH_ARENA_RESERVE (64 * 1024 * 1024)
+#endif
+
+// NOTE: Committed memory above this is given back when a scratch arena is fully rewound
+#ifndef CM_SCRATCH_ARENA_HIGH_WATER_MARK
+#define CM_SCRATCH_ARENA_HIGH_WATER_MARK (256 * 1024)
+#endif
+
+CM_DEF cmTempArenaMemory cm_scratch_begin(cmArena **conflicts, isize conflict_count);
+CM_DEF void              cm_scratch_end  (cmTempArenaMemory scratch);
+
+
+///////////////////////////////////////////////////////////////
+//
+// Stack Allocator
+//
+// LIFO allocator for code that allocates and frees in nested order. Every allocation
+// is preceded by a cmStackHeader recording the previous top, so freeing the top pops
+// it in O(1) and the top can be resized in place. Freeing anything else only marks it,
+// the space is reclaimed once everything above it has been popped.
+//
+////////////////////////////////////////////////////////////////
+
+typedef struct cmStackHeader {
+	isize prev_offset; // NOTE: High bit set once the block has been freed
+	void *prev_top;
+} cmStackHeader;
+
+typedef struct cmStackAllocator {
+	cmAllocator backing;
+	void *      physical_start;
+	isize       total_size;
+	isize       offset; // NOTE: End of the top block
+	void *      top;    // NOTE: Data of the top block, NULL when empty
+} cmStackAllocator;
+
+typedef struct cmStackMarker {
+	cmStackAllocator *stack;
+	isize             offset;
+	void *            top;
+} cmStackMarker;
+
+CM_DEF void 			cm_stack_init_from_memory   (cmStackAllocator *s, void *start, isize size);
+CM_DEF void 			cm_stack_init_from_allocator(cmStackAllocator *s, cmAllocator backing, isize size);
+CM_DEF void 			cm_stack_free               (cmStackAllocator *s);
+
+// NOTE: Everything allocated after cm_stack_marker is released by cm_stack_rewind
+CM_DEF cmStackMarker 	cm_stack_marker(cmStackAllocator *s);
+CM_DEF void          	cm_stack_rewind(cmStackMarker marker);
+
+// Allocation Types: alloc, free, free_all, resize
+CM_DEF cmAllocator 		cm_stack_allocator(cmStackAllocator *s);
+CM_DEF CM_ALLOCATOR_PROC(cm_stack_allocator_proc);
+
+
+///////////////////////////////////////////////////////////////
+//
+// Tracking Allocator
+//
+// Wraps any allocator and records live and peak bytes, allocation counts, a size
+// histogram and per call site totals. Each allocation carries a cmTrackingHeader so
+// frees can be accounted for without a size. Call sites are only known when the
+// allocation goes through the cm_*_at functions, define CM_TRACK_CALL_SITES to route
+// cm_alloc, cm_alloc_align, cm_resize and cm_resize_align through them.
+//
+// NOTE: Thread-safe as long as the backing allocator is. The statistics themselves live
+// on cm_heap_allocator so they survive a free all of the backing allocator.
+//
+////////////////////////////////////////////////////////////////
+
+#define CM_TRACKING_HISTOGRAM_BINS 32 // NOTE: Bin i counts sizes in [2^i, 2^(i+1)), the last one everything above
+
+typedef struct cmTrackingHeader {
+	isize size;
+	i32   site;   // NOTE: Index into sites, -1 if unknown
+	i32   offset; // NOTE: From the start of the backing allocation to the data
+} cmTrackingHeader;
+
+typedef struct cmTrackingSite {
+	char const *file; // NOTE: Compared by pointer, __FILE__ literals are not merged across translation units
+	i32         line;
+	isize       live_bytes;
+	isize       peak_bytes;
+	isize       live_count;
+	isize       total_count;
+	isize       total_bytes;
+} cmTrackingSite;
+
+typedef struct cmTrackingAllocator {
+	cmAllocator     backing;
+	cmAtomic32      lock;
+
+	isize           live_bytes;
+	isize           peak_bytes;
+	isize           live_count;
+	isize           total_count;
+	isize           total_bytes;
+	isize           histogram[CM_TRACKING_HISTOGRAM_BINS];
+
+	cmTrackingSite *sites;
+	isize           site_count;
+	isize           site_capacity;
+	i32 *           site_table; // NOTE: Open addressing, index into sites or -1
+	isize           site_table_capacity;
+} cmTrackingAllocator;
+
+CM_DEF void 			cm_tracking_init(cmTrackingAllocator *t, cmAllocator backing);
+CM_DEF void 			cm_tracking_free(cmTrackingAllocator *t); // NOTE: Frees the statistics, not the live allocations
+
+struct cmFile;
+
+// NOTE: Human readable summary, and the same data as a JSON object
+CM_DEF void 			cm_tracking_report   (cmTrackingAllocator *t, struct cmFile *f);
+CM_DEF void 			cm_tracking_dump_json(cmTrackingAllocator *t, struct cmFile *f);
+
+// Allocation Types: alloc, free, resize
+CM_DEF cmAllocator cm_tracking_allocator(cmTrackingAllocator *t);
+CM_DEF CM_ALLOCATOR_PROC(cm_tracking_allocator_proc);
+
+CM_DEF void 		*cm_alloc_align_at (cmAllocator a, isize size, isize alignment, char const *file, i32 line);
+CM_DEF void 		*cm_alloc_at       (cmAllocator a, isize size, char const *file, i32 line);
+CM_DEF void 		*cm_resize_align_at(cmAllocator a, void *ptr, isize old_size, isize new_size, isize alignment, char const *file, i32 line);
+CM_DEF void 		*cm_resize_at      (cmAllocator a, void *ptr, isize old_size, isize new_size, char const *file, i32 line);
+
+#if defined(CM_TRACK_CALL_SITES)
+#define cm_alloc_align(a, size, alignment)                cm_alloc_align_at(a, size, alignment, __FILE__, __LINE__)
+#define cm_alloc(a, size)                                 cm_alloc_at(a, size, __FILE__, __LINE__)
+#define cm_resize_align(a, ptr, old_size, new_size, align) cm_resize_align_at(a, ptr, old_size, new_size, align, __FILE__, __LINE__)
+#define cm_resize(a, ptr, old_size, new_size)             cm_resize_at(a, ptr, old_size, new_size, __FILE__, __LINE__)
+#endif
+
+
+///////////////////////////////////////////////////////////////
+//
+// Thread-Caching Heap Allocator - TCMalloc like
+//
+// Small requests (<= CM_TC_HEAP_MAX_SMALL_SIZE) are rounded up to one of
+// CM_TC_HEAP_CLASS_COUNT size classes and served from a per-thread cache.
+// A cache miss fetches a batch of blocks from the central free list of that
+// class, which carves them out of spans taken from the page heap.
+// Spans are CM_TC_HEAP_SPAN_SIZE aligned regions from cm_vm_alloc, so a
+// pointer finds its span header by masking off the low bits.
+// Large requests get their own span straight from virtual memory.
+//
+// NOTE: Alignments up to CM_TC_HEAP_SPAN_SIZE/2 are supported.
+// NOTE: Thread caches are flushed on thread exit with pthreads, on other
+// systems call cm_tc_heap_thread_flush before a thread finishes.
+//
+///////////////////////////////////////////////////////////////
+
+#ifndef CM_TC_HEAP_SPAN_SIZE
+#define CM_TC_HEAP_SPAN_SIZE      (256 * 1024)
+#endif
+
+#ifndef CM_TC_HEAP_CHUNK_SPANS
+#define CM_TC_HEAP_CHUNK_SPANS    16 // NOTE: Spans reserved from the OS at once
+#endif
+
+#ifndef CM_TC_HEAP_MAX_FREE_SPANS
+#define CM_TC_HEAP_MAX_FREE_SPANS 64 // NOTE: Free spans above this are purged back to the OS
+#endif
+
+#ifndef CM_TC_HEAP_MAX_RUN_SPANS
+#define CM_TC_HEAP_MAX_RUN_SPANS  32 // NOTE: Larger allocations are unmapped as soon as they are freed
+#endif
+
+#define CM_TC_HEAP_MAX_SMALL_SIZE (32 * 1024)
+#define CM_TC_HEAP_CLASS_COUNT    40
+
+CM_STATIC_ASSERT(CM_TC_HEAP_SPAN_SIZE >= 4*CM_TC_HEAP_MAX_SMALL_SIZE);
+
+// Allocation Types: alloc, free, resize
+CM_DEF cmAllocator cm_tc_heap_allocator(void);
+CM_DEF CM_ALLOCATOR_PROC(cm_tc_heap_allocator_proc);
+
+// NOTE: Returns every block cached by the calling thread to the central free lists
+CM_DEF void        cm_tc_heap_thread_flush(void);
 
 CM_END_EXTERN
 
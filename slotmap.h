@@ -0,0 +1,195 @@
+/********************************************************************************
+ * MIT License
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Copyright (c) 2020 Sarayu Nhookeaw
+ *
+ ********************************************************************************/
+
+#ifndef CM_SLOTMAP_H
+#define CM_SLOTMAP_H
+
+#include "memory.h"
+#include "dynarray.h"
+
+CM_BEGIN_EXTERN
+
+/////////////////////////////////////////////////////////////////////////////////
+//
+// Instantiated Slot Map
+//
+// Stores values behind generation checked handles. The values are kept packed in
+// `values`, so iterating is a plain loop over cmArray(VALUE), and a removal moves the
+// last value into the hole. A handle keeps working however the storage moves and stops
+// working once its value is removed, even after the slot is reused.
+//
+// Slot map type and function declaration, call: CM_SLOT_MAP_DECLARE(PREFIX, NAME, FUNC, VALUE)
+// Slot map function definitions, call: CM_SLOT_MAP_DEFINE(NAME, FUNC, VALUE)
+//
+//     PREFIX  - a prefix for function prototypes e.g. extern, static, etc.
+//     NAME    - Name of the Slot Map
+//     FUNC    - the name will prefix function names
+//     VALUE   - the type of the value to be stored
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+#if 0 // Example
+CM_SLOT_MAP(static, EntityMap, entity_map_, Entity);
+
+void foo(void) {
+	isize i;
+	EntityMap m;
+	cmSlotHandle h;
+
+	entity_map_init(&m, cm_heap_allocator());
+	h = entity_map_insert(&m, some_entity);
+
+	for (i = 0; i < cm_array_count(m.values); i++)
+		update(&m.values[i]);
+
+	if (entity_map_get(&m, h)) // NULL once removed
+		entity_map_remove(&m, h);
+	entity_map_destroy(&m);
+}
+#endif
+
+// NOTE: Slot index in the low 32 bits, generation in the high 32 bits. A slot's generation is
+// odd while it holds a value, so CM_SLOT_HANDLE_NONE (0) never refers to anything.
+typedef u64 cmSlotHandle;
+
+#define CM_SLOT_HANDLE_NONE           (cast(cmSlotHandle)0)
+#define CM_SLOT_HANDLE(index, gen)    ((cast(u64)(gen) << 32) | cast(u32)(index))
+#define cm_slot_handle_index(handle)  (cast(u32)(handle))
+#define cm_slot_handle_gen(handle)    (cast(u32)((handle) >> 32))
+
+#define CM_SLOT_MAP_FREE_END U32_MAX
+
+typedef struct cmSlotMapSlot {
+	u32 generation;
+	u32 index; // NOTE: Index into the values while in use, next free slot otherwise
+} cmSlotMapSlot;
+
+#define CM_SLOT_MAP(PREFIX, NAME, FUNC, VALUE) \
+	CM_SLOT_MAP_DECLARE(PREFIX, NAME, FUNC, VALUE); \
+	CM_SLOT_MAP_DEFINE(NAME, FUNC, VALUE);
+
+#define CM_SLOT_MAP_DECLARE(PREFIX, NAME, FUNC, VALUE) \
+typedef struct NAME { \
+	cmArray(VALUE)         values; /* NOTE: Packed, iterate over these */ \
+	cmArray(u32)           value_slots; /* NOTE: Slot of each value */ \
+	cmArray(cmSlotMapSlot) slots; \
+	u32                    free_head; \
+} NAME; \
+\
+PREFIX void         CM_JOIN2(FUNC,init)     (NAME *m, cmAllocator a); \
+PREFIX void         CM_JOIN2(FUNC,destroy)  (NAME *m); \
+PREFIX void         CM_JOIN2(FUNC,reserve)  (NAME *m, isize capacity); \
+PREFIX void         CM_JOIN2(FUNC,clear)    (NAME *m); \
+PREFIX cmSlotHandle CM_JOIN2(FUNC,insert)   (NAME *m, VALUE value); \
+PREFIX VALUE *      CM_JOIN2(FUNC,get)      (NAME *m, cmSlotHandle handle); \
+PREFIX b32          CM_JOIN2(FUNC,remove)   (NAME *m, cmSlotHandle handle); \
+PREFIX cmSlotHandle CM_JOIN2(FUNC,handle_of)(NAME *m, isize value_index); \
+
+#define CM_SLOT_MAP_DEFINE(NAME, FUNC, VALUE) \
+void CM_JOIN2(FUNC,init)(NAME *m, cmAllocator a) { \
+	cm_array_init(m->values,      a); \
+	cm_array_init(m->value_slots, a); \
+	cm_array_init(m->slots,       a); \
+	m->free_head = CM_SLOT_MAP_FREE_END; \
+} \
+\
+void CM_JOIN2(FUNC,destroy)(NAME *m) { \
+	if (m->slots)       cm_array_free(m->slots); \
+	if (m->value_slots) cm_array_free(m->value_slots); \
+	if (m->values)      cm_array_free(m->values); \
+} \
+\
+void CM_JOIN2(FUNC,reserve)(NAME *m, isize capacity) { \
+	cm_array_reserve(m->values,      capacity); \
+	cm_array_reserve(m->value_slots, capacity); \
+	cm_array_reserve(m->slots,       capacity); \
+} \
+\
+void CM_JOIN2(FUNC,clear)(NAME *m) { \
+	isize i; \
+	/* NOTE: Bumping the generations keeps old handles from matching */ \
+	for (i = 0; i < cm_array_count(m->values); i++) { \
+		cmSlotMapSlot *s = &m->slots[m->value_slots[i]]; \
+		s->generation++; \
+		s->index = m->free_head; \
+		m->free_head = m->value_slots[i]; \
+	} \
+	cm_array_clear(m->values); \
+	cm_array_clear(m->value_slots); \
+} \
+\
+cmSlotHandle CM_JOIN2(FUNC,insert)(NAME *m, VALUE value) { \
+	u32 slot_index; \
+	cmSlotMapSlot *s; \
+	if (m->free_head != CM_SLOT_MAP_FREE_END) { \
+		slot_index = m->free_head; \
+		m->free_head = m->slots[slot_index].index; \
+	} else { \
+		cmSlotMapSlot empty = {0}; \
+		CM_ASSERT(cm_array_count(m->slots) < CM_SLOT_MAP_FREE_END); \
+		slot_index = cast(u32)cm_array_count(m->slots); \
+		cm_array_append(m->slots, empty); \
+	} \
+	s = &m->slots[slot_index]; \
+	s->generation++; \
+	s->index = cast(u32)cm_array_count(m->values); \
+	cm_array_append(m->values, value); \
+	cm_array_append(m->value_slots, slot_index); \
+	return CM_SLOT_HANDLE(slot_index, s->generation); \
+} \
+\
+VALUE *CM_JOIN2(FUNC,get)(NAME *m, cmSlotHandle handle) { \
+	u32 slot_index = cm_slot_handle_index(handle); \
+	cmSlotMapSlot *s; \
+	if (slot_index >= cast(u64)cm_array_count(m->slots)) \
+		return NULL; \
+	s = &m->slots[slot_index]; \
+	if (s->generation != cm_slot_handle_gen(handle) || (s->generation & 1) == 0) \
+		return NULL; \
+	return &m->values[s->index]; \
+} \
+\
+b32 CM_JOIN2(FUNC,remove)(NAME *m, cmSlotHandle handle) { \
+	u32 slot_index = cm_slot_handle_index(handle); \
+	u32 index, last; \
+	cmSlotMapSlot *s; \
+	if (CM_JOIN2(FUNC,get)(m, handle) == NULL) \
+		return false; \
+	s = &m->slots[slot_index]; \
+	index = s->index; \
+	last  = cast(u32)cm_array_count(m->values) - 1; \
+	if (index != last) { \
+		m->values[index]      = m->values[last]; \
+		m->value_slots[index] = m->value_slots[last]; \
+		m->slots[m->value_slots[index]].index = index; \
+	} \
+	cm_array_pop(m->values); \
+	cm_array_pop(m->value_slots); \
+	s->generation++; \
+	s->index = m->free_head; \
+	m->free_head = slot_index; \
+	return true; \
+} \
+\
+cmSlotHandle CM_JOIN2(FUNC,handle_of)(NAME *m, isize value_index) { \
+	u32 slot_index; \
+	CM_ASSERT(value_index >= 0 && value_index < cm_array_count(m->values)); \
+	slot_index = m->value_slots[value_index]; \
+	return CM_SLOT_HANDLE(slot_index, m->slots[slot_index].generation); \
+} \
+
+CM_END_EXTERN
+
+#endif //CM_SLOTMAP_H
@@ -42,8 +42,8 @@ cm_string_make_reserve(cmAllocator a, isize capacity) {
 	header = CM_STRING_HEADER(str);
 	header->allocator = a;
 	header->length    = 0;
-	header->capacity  = capacity;
-	str[capacity] = '\0';
+	header->capacity  = cm_usable_size(a, ptr, header_size + capacity + 1) - header_size - 1;
+	str[header->capacity] = '\0';
 
 	return str;
 }
@@ -69,7 +69,7 @@ cm_string_make_length(cmAllocator a, void const *init_str, isize num_bytes) {
 	header = CM_STRING_HEADER(str);
 	header->allocator = a;
 	header->length    = num_bytes;
-	header->capacity  = num_bytes;
+	header->capacity  = cm_usable_size(a, ptr, header_size + num_bytes + 1) - header_size - 1;
 	if (num_bytes && init_str) {
 		cm_memcopy(str, init_str, num_bytes);
 	}
@@ -206,7 +206,8 @@ cm_string_make_space_for(cmString str, isize add_len) {
 		header->allocator = a;
 
 		str = cast(cmString)(header+1);
-		cm__set_string_capacity(str, new_len);
+		// NOTE: Grow into whatever the allocator rounded the block up to
+		cm__set_string_capacity(str, cm_usable_size(a, new_ptr, new_size) - cm_size_of(cmStringHeader) - 1);
 
 		return str;
 	}
@@ -337,6 +337,19 @@ public:
 #define CN_UNLIKELY(x) (x)
 #endif
 
+/*
+ * start loading the cache line at `ptr` ahead of a read, e.g. for the next
+ * few lookups of a batch. A prefetch never faults, any address is fine
+ */
+#if defined(__clang__) || defined(__GNUC__)
+#define CM_PREFETCH(ptr) __builtin_prefetch((ptr), 0, 3)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define CM_PREFETCH(ptr) _mm_prefetch(cast(char const *)(ptr), _MM_HINT_T0)
+#else
+#define CM_PREFETCH(ptr) cast(void)(ptr)
+#endif
+
 #ifndef cm_kilobytes
 #define cm_kilobytes(x) (            (x) * (i64)(1024))
 #endif